@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "command.h"
+#include "matrix.h"
+#include "expr.h"
+#include "access.h"
+
+#define MAX_EXPRESSION_LEN 1024
+
+/*
+ * PURPOSE: records that a file now holds the result of fadd or fshift,
+ *	which names the matrix after the file
+ * INPUTS:
+ *	names how names are resolved
+ *	file the output file
+ * RETURN:
+ *	true if recorded
+ **/
+static bool set_file_result (const Access_Names_t* names, const char* file) {
+	char key[RESOURCE_LEN];
+	char name[MATRIX_NAME_LEN] = {0};
+	const char* base = strrchr(file, '/');
+	strncpy(name, base ? base + 1 : file, sizeof(name) - 1);
+	snprintf(key, sizeof(key), "f:%s", file);
+	return names->set_name(names->context, key, name);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Adds a matrix or file to what a command reads or writes. A
+*		   matrix counts as the matrix that owns its data
+* Input: How names are resolved,
+*		 the command's accesses,
+*		 'm' for a matrix, 'f' for a file,
+*		 the matrix or file name,
+*		 true if the command changes it
+* Return: void
+***/
+void add_command_access (const Access_Names_t* names, Command_Access_t* a, char kind,
+			const char* name, bool write) {
+	char root[MATRIX_NAME_LEN];
+	if (kind == 'm') {
+		names->root_matrix_name(names->context, name, root);
+		name = root;
+		a->writes_matrix |= write;
+	}
+	if (write && a->num_writes < 2) {
+		snprintf(a->writes[a->num_writes++], RESOURCE_LEN, "%c:%s", kind, name);
+	}
+	else if (!write && a->num_reads < MAX_ACCESSES) {
+		snprintf(a->reads[a->num_reads++], RESOURCE_LEN, "%c:%s", kind, name);
+	}
+	else {
+		a->barrier = true;
+	}
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Works out what a command reads and writes, following the
+*		   arguments run_commands takes. Anything not understood is a barrier
+* Input: How names are resolved,
+*		 the parsed command,
+*		 where the accesses go
+* Return: True unless out of memory
+***/
+bool analyse_command (const Access_Names_t* names, const Commands_t* cmd, Command_Access_t* a) {
+	char** args = cmd->cmds;
+	const unsigned int n = cmd->num_cmds;
+	const char* name = args[0];
+	memset(a, 0, sizeof(Command_Access_t));
+
+	/*names and paths too long for a resource could be mistaken for each other*/
+	const unsigned int checked = strcmp(name, "eval") == 0 && n > 2 ? 2 : n;
+	for (unsigned int i = 1; i < checked; ++i) {
+		if (strlen(args[i]) + 3 > RESOURCE_LEN) {
+			a->barrier = true;
+			return true;
+		}
+	}
+
+	if (((strcmp(name, "display") == 0 || strcmp(name, "sum") == 0) && n == 2)
+		|| ((strcmp(name, "histogram") == 0 || strcmp(name, "topk") == 0) && n == 3)) {
+		add_command_access(names, a, 'm', args[1], false);
+	}
+	else if ((strcmp(name, "add") == 0 && n == 4)
+		|| (strcmp(name, "convolve") == 0 && (n == 4 || n == 5))) {
+		add_command_access(names, a, 'm', args[1], false);
+		add_command_access(names, a, 'm', args[2], false);
+		add_command_access(names, a, 'm', args[3], true);
+	}
+	else if ((strcmp(name, "duplicate") == 0 && n == 3)
+		|| (strcmp(name, "reduce") == 0 && n == 5)) {
+		add_command_access(names, a, 'm', args[1], false);
+		add_command_access(names, a, 'm', args[n - 1], true);
+	}
+	else if (strcmp(name, "equal") == 0 && n == 3) {
+		add_command_access(names, a, 'm', args[1], false);
+		add_command_access(names, a, 'm', args[2], false);
+	}
+	else if (strcmp(name, "shift") == 0 && n == 4) {
+		add_command_access(names, a, 'm', args[1], true);
+	}
+	else if (strcmp(name, "shift") == 0 && n == 5) {
+		add_command_access(names, a, 'm', args[1], false);
+		add_command_access(names, a, 'm', args[4], true);
+	}
+	/*regionsum caches its table in the matrix*/
+	else if ((strcmp(name, "regionsum") == 0 && n == 6)
+		|| (strcmp(name, "sortrows") == 0 && n == 3)
+		|| (strcmp(name, "create") == 0 && n == 4)
+		|| (strcmp(name, "gen") == 0 && (n == 5 || n == 6))
+		|| (strcmp(name, "random") == 0 && n == 4)) {
+		add_command_access(names, a, 'm', args[1], true);
+	}
+	else if (strcmp(name, "view") == 0 && n == 5) {
+		/*the view shares data with the owner from now on*/
+		char key[RESOURCE_LEN];
+		char root[MATRIX_NAME_LEN];
+		add_command_access(names, a, 'm', args[1], true);
+		add_command_access(names, a, 'm', args[2], true);
+		names->root_matrix_name(names->context, args[2], root);
+		snprintf(key, sizeof(key), "m:%s", args[1]);
+		if (strcmp(root, args[1]) != 0 && !names->set_name(names->context, key, root)) {
+			return false;
+		}
+	}
+	else if (strcmp(name, "op") == 0 && (n == 4 || n == 5)) {
+		for (unsigned int i = 2; i + 1 < n; ++i) {
+			add_command_access(names, a, 'm', args[i], false);
+		}
+		add_command_access(names, a, 'm', args[n - 1], true);
+	}
+	else if (strcmp(name, "eval") == 0 && n >= 4 && strcmp(args[2], "=") == 0) {
+		char text[MAX_EXPRESSION_LEN] = "";
+		char scanned[MAX_ACCESSES][MATRIX_NAME_LEN];
+		size_t len = 0;
+		for (unsigned int i = 3; i < n && len < sizeof(text); ++i) {
+			len += snprintf(text + len, sizeof(text) - len, "%s ", args[i]);
+		}
+		const unsigned int count = scan_expression_names(text, scanned, MAX_ACCESSES);
+		a->barrier = count > MAX_ACCESSES;
+		for (unsigned int i = 0; i < count && i < MAX_ACCESSES; ++i) {
+			add_command_access(names, a, 'm', scanned[i], false);
+		}
+		add_command_access(names, a, 'm', args[1], true);
+	}
+	else if (strcmp(name, "read") == 0 && n == 2) {
+		char matrix[MATRIX_NAME_LEN];
+		if (!names->file_matrix_name(names->context, args[1], matrix)) {
+			a->barrier = true;
+			return true;
+		}
+		add_command_access(names, a, 'f', args[1], false);
+		add_command_access(names, a, 'm', matrix, true);
+	}
+	else if (strcmp(name, "write") == 0 && n == 2) {
+		/*write names the file after the matrix*/
+		char key[RESOURCE_LEN];
+		add_command_access(names, a, 'm', args[1], false);
+		add_command_access(names, a, 'f', args[1], true);
+		snprintf(key, sizeof(key), "f:%s", args[1]);
+		return names->set_name(names->context, key, args[1]);
+	}
+	else if (strcmp(name, "fadd") == 0 && n == 4) {
+		add_command_access(names, a, 'f', args[1], false);
+		add_command_access(names, a, 'f', args[2], false);
+		add_command_access(names, a, 'f', args[3], true);
+		return set_file_result(names, args[3]);
+	}
+	else if (strcmp(name, "fshift") == 0 && n == 5) {
+		add_command_access(names, a, 'f', args[1], false);
+		add_command_access(names, a, 'f', args[4], true);
+		return set_file_result(names, args[4]);
+	}
+	else if (strcmp(name, "verify") == 0 && n >= 2) {
+		for (unsigned int i = 1; i < n; ++i) {
+			add_command_access(names, a, 'f', args[i], false);
+		}
+	}
+	else {
+		/*budget, trace, workspaces and anything unknown run alone*/
+		a->barrier = true;
+	}
+	return true;
+}
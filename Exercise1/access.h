@@ -0,0 +1,36 @@
+#ifndef _ACCESS_H_
+#define _ACCESS_H_
+
+#define MAX_ACCESSES 50		/* a command has at most 50 tokens */
+#define RESOURCE_LEN (MATRIX_NAME_LEN + 8)
+
+/*
+ * What one command reads and writes. Matrices are the resource
+ * "m:<matrix>" and files "f:<file>". A barrier touches everything.
+ */
+typedef struct {
+	bool barrier;
+	bool writes_matrix;
+	unsigned int num_reads;
+	unsigned int num_writes;
+	char reads[MAX_ACCESSES][RESOURCE_LEN];
+	char writes[2][RESOURCE_LEN];
+} Command_Access_t;
+
+/*
+ * How names are resolved while commands are analysed: the matrix that owns
+ * the data of a view, the matrix a file holds, and what a command makes a
+ * "m:<view>" or "f:<file>" name refer to from then on.
+ */
+typedef struct {
+	void (*root_matrix_name) (void* context, const char* name, char* root);
+	bool (*file_matrix_name) (void* context, const char* file, char* name);
+	bool (*set_name) (void* context, const char* key, const char* value);
+	void* context;
+} Access_Names_t;
+
+void add_command_access (const Access_Names_t* names, Command_Access_t* a, char kind,
+			const char* name, bool write);
+bool analyse_command (const Access_Names_t* names, const Commands_t* cmd, Command_Access_t* a);
+
+#endif
@@ -1,12 +1,36 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
 #include "command.h"
+#include "trace.h"
 
 #define MAX_CMD_COUNT 50
-#define MAX_CMD_LEN 25
+
+/*
+ * While commands run on several threads stdout is a stream that hands what
+ * each thread prints to that thread's capture, or to the real stdout on
+ * threads that capture nothing.
+ */
+static __thread FILE* command_output = NULL;
+static FILE* demux = NULL;
+
+/*
+ * PURPOSE: sends printf to the capture of the command running on this
+ *	thread, or to the real stdout on threads that run no command
+ * INPUTS:
+ *	cookie the real stdout
+ *	buf size what was printed
+ * RETURN:
+ *	the bytes written, -1 on failure
+ **/
+static ssize_t write_command_output (void* cookie, const char* buf, size_t size) {
+	FILE* out = command_output ? command_output : (FILE*) cookie;
+	return fwrite(buf, 1, size, out) == size ? (ssize_t) size : -1;
+}
 
 
 	// FUNCTION COMMENT
@@ -18,6 +42,7 @@
  ***/
 
 bool parse_user_input (const char* input, Commands_t** cmd) {
+	TRACE_SCOPE("parse_user_input", "parse");
 	
 	// ERROR CHECK INCOMING PARAMETERS
 	if(!input || strcmp(input, "\n") == 0){
@@ -36,16 +61,18 @@ bool parse_user_input (const char* input, Commands_t** cmd) {
 
 	unsigned int i = 0;
 	char *token;
-	token = strtok(string, " \n");
+	char *rest = NULL;	/*strtok_r, commands are parsed on several threads*/
+	token = strtok_r(string, " \n", &rest);
 	for (; token != NULL && i < MAX_CMD_COUNT; ++i) {
-		(*cmd)->cmds[i] = calloc(MAX_CMD_LEN,sizeof(char));
+		/*tokens are kept whole, names and paths are checked where they are used*/
+		(*cmd)->cmds[i] = strdup(token);
 		if (!(*cmd)->cmds[i]) {
 			perror("Allocation Error\n");
+			free(string);
 			return false;
 		}	
-		strncpy((*cmd)->cmds[i],token, strlen(token) + 1);
 		(*cmd)->num_cmds++;
-		token = strtok(NULL, " \n");
+		token = strtok_r(NULL, " \n", &rest);
 	}
 	free(string);
 	return true;
@@ -73,3 +100,62 @@ void destroy_commands(Commands_t** cmd) {
 	*cmd = NULL;
 }
 
+	// FUNCTION COMMENT
+/***
+ * Purpose: Lets every thread capture what the commands it runs print, by
+ *	 	  putting a stream in front of stdout until restore_command_output
+ * Input: void
+ * Return: The real stdout, NULL if the stream could not be made
+ ***/
+FILE* redirect_command_output (void) {
+	static const cookie_io_functions_t command_streams = { .write = write_command_output };
+	fflush(stdout);
+	FILE* real_stdout = stdout;
+	demux = fopencookie(real_stdout, "w", command_streams);
+	if (!demux) {
+		return NULL;
+	}
+	setvbuf(demux, NULL, _IONBF, 0);
+	stdout = demux;
+	return real_stdout;
+}
+
+	// FUNCTION COMMENT
+/***
+ * Purpose: Puts back the stdout redirect_command_output replaced
+ * Input: The real stdout it returned
+ * Return: void
+ ***/
+void restore_command_output (FILE* real_stdout) {
+	stdout = real_stdout;
+	fclose(demux);
+	demux = NULL;
+	fflush(stdout);
+}
+
+	// FUNCTION COMMENT
+/***
+ * Purpose: Collects what this thread prints from now on in memory
+ * Input: Receives the printed text once end_command_output is called,
+ *	 	  receives its length
+ * Return: The capture, NULL if it could not be made and printing goes
+ *	 	   to the real stdout
+ ***/
+FILE* capture_command_output (char** output, size_t* output_len) {
+	FILE* capture = open_memstream(output, output_len);
+	command_output = capture;
+	return capture;
+}
+
+	// FUNCTION COMMENT
+/***
+ * Purpose: Stops the capture of this thread and completes its text
+ * Input: The capture given by capture_command_output
+ * Return: void
+ ***/
+void end_command_output (FILE* capture) {
+	command_output = NULL;
+	if (capture) {
+		fclose(capture);
+	}
+}
@@ -8,5 +8,9 @@ typedef struct {
 
 bool parse_user_input (const char* input, Commands_t** cmd);
 void destroy_commands(Commands_t** cmd);
+FILE* redirect_command_output (void);
+void restore_command_output (FILE* real_stdout);
+FILE* capture_command_output (char** output, size_t* output_len);
+void end_command_output (FILE* capture);
 
 #endif
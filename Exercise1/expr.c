@@ -0,0 +1,593 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "matrix.h"
+#include "expr.h"
+#include "trace.h"
+
+#define EXPR_MAX_NODES 64
+/* values per tile, every intermediate tile stays in L1 */
+#define EXPR_TILE 512
+
+/*defined in main.c*/
+unsigned int find_matrix_given_name (Matrix_t** mats, unsigned int num_mats,
+			const char* target);
+
+typedef enum {
+	NODE_MATRIX,
+	NODE_CONST,
+	NODE_OP
+} Node_Kind_t;
+
+/*
+ * Nodes are stored children first, so evaluating them in index order
+ * always finds the operands ready. Identical nodes are shared, which turns
+ * the parse tree into a DAG where every matrix is read once per tile.
+ */
+typedef struct {
+	Node_Kind_t kind;
+	Matrix_Op_t op;
+	int left;
+	int right;
+	unsigned int value;	/* constant value or scalar operand */
+	char name[MATRIX_NAME_LEN];
+	Matrix_t* matrix;
+} Expression_Node_t;
+
+struct Expression {
+	Expression_Node_t nodes[EXPR_MAX_NODES];
+	unsigned int num_nodes;
+	int root;
+	const char* text;
+	size_t pos;
+	bool failed;
+};
+
+/*
+ * PURPOSE: adds a node unless an identical one already exists
+ * INPUTS:
+ *	e the expression being built
+ *	node the node to add
+ * RETURN:
+ *	the index of the node, -1 when the expression is too large
+ **/
+static int add_node (Expression_t* e, const Expression_Node_t* node) {
+	for (unsigned int i = 0; i < e->num_nodes; ++i) {
+		const Expression_Node_t* n = &e->nodes[i];
+		if (n->kind == node->kind && n->op == node->op && n->left == node->left
+			&& n->right == node->right && n->value == node->value
+			&& strncmp(n->name, node->name, MATRIX_NAME_LEN) == 0) {
+			return i;
+		}
+	}
+	if (e->num_nodes == EXPR_MAX_NODES) {
+		printf("Expression has more than %d terms\n", EXPR_MAX_NODES);
+		e->failed = true;
+		return -1;
+	}
+	e->nodes[e->num_nodes] = *node;
+	return e->num_nodes++;
+}
+
+/*
+ * PURPOSE: adds a constant node
+ * INPUTS:
+ *	e the expression being built
+ *	value the constant
+ * RETURN:
+ *	the index of the node
+ **/
+static int add_const (Expression_t* e, unsigned int value) {
+	Expression_Node_t node = { .kind = NODE_CONST, .left = -1, .right = -1, .value = value };
+	return add_node(e, &node);
+}
+
+/*
+ * PURPOSE: computes one operation on two constants
+ * INPUTS:
+ *	op the operation
+ *	a b the operands
+ * RETURN:
+ *	the folded value
+ **/
+static unsigned int fold (Matrix_Op_t op, unsigned int a, unsigned int b) {
+	unsigned int r = 0;
+	apply_row_operation(op, &a, &b, b, &r, 1);
+	return r;
+}
+
+/*
+ * PURPOSE: adds an operation node. Constant operands are folded, and an
+ *	addition, subtraction or multiplication by a constant becomes a
+ *	scalar operation so the constant never needs a tile of its own
+ * INPUTS:
+ *	e the expression being built
+ *	op the matrix-matrix operation
+ *	left right the operand nodes (right is -1 for not)
+ * RETURN:
+ *	the index of the node, -1 on failure
+ **/
+static int add_op (Expression_t* e, Matrix_Op_t op, int left, int right) {
+	if (left < 0 || (op != MATRIX_OP_NOT && right < 0)) {
+		return -1;
+	}
+	const Expression_Node_t* l = &e->nodes[left];
+	const Expression_Node_t* r = right >= 0 ? &e->nodes[right] : NULL;
+
+	if (l->kind == NODE_CONST && (!r || r->kind == NODE_CONST)) {
+		return add_const(e, fold(op, l->value, r ? r->value : 0));
+	}
+	if ((op == MATRIX_OP_ADD || op == MATRIX_OP_MUL) && l->kind == NODE_CONST) {
+		int swap = left;
+		left = right;
+		right = swap;
+		l = &e->nodes[left];
+		r = &e->nodes[right];
+	}
+
+	Expression_Node_t node = { .kind = NODE_OP, .op = op, .left = left, .right = right };
+	if (r && r->kind == NODE_CONST && (op == MATRIX_OP_ADD || op == MATRIX_OP_SUB || op == MATRIX_OP_MUL)) {
+		node.op = op == MATRIX_OP_MUL ? MATRIX_OP_MUL_SCALAR : MATRIX_OP_ADD_SCALAR;
+		node.value = op == MATRIX_OP_SUB ? 0u - r->value : r->value;
+		node.right = -1;
+	}
+	return add_node(e, &node);
+}
+
+/*
+ * PURPOSE: skips blanks and tells whether the text continues with a token
+ * INPUTS:
+ *	e the expression being parsed
+ *	token the token to look for
+ * RETURN:
+ *	true if the token was found and consumed
+ **/
+static bool accept_token (Expression_t* e, const char* token) {
+	while (isspace((unsigned char) e->text[e->pos])) {
+		++e->pos;
+	}
+	const size_t len = strlen(token);
+	if (strncmp(e->text + e->pos, token, len) == 0) {
+		e->pos += len;
+		return true;
+	}
+	return false;
+}
+
+static int parse_or (Expression_t* e);
+
+/*
+ * PURPOSE: parses a matrix name, a number or a parenthesized expression
+ * INPUTS:
+ *	e the expression being parsed
+ * RETURN:
+ *	the index of the node, -1 on a syntax error
+ **/
+static int parse_primary (Expression_t* e) {
+	if (accept_token(e, "(")) {
+		int inner = parse_or(e);
+		if (!accept_token(e, ")")) {
+			printf("Missing ) at position %zu\n", e->pos);
+			e->failed = true;
+			return -1;
+		}
+		return inner;
+	}
+	const char* start = e->text + e->pos;
+	if (isdigit((unsigned char) *start)) {
+		char* end = NULL;
+		errno = 0;
+		unsigned long long value = strtoull(start, &end, 0);
+		if (errno == ERANGE || value > UINT_MAX) {
+			printf("Number at position %zu does not fit in an unsigned int\n", e->pos);
+			e->failed = true;
+			return -1;
+		}
+		e->pos += end - start;
+		return add_const(e, (unsigned int) value);
+	}
+	size_t len = 0;
+	while (isalnum((unsigned char) start[len]) || start[len] == '_' || start[len] == '.') {
+		++len;
+	}
+	if (len == 0 || len >= MATRIX_NAME_LEN) {
+		printf("Expected a matrix name at position %zu\n", e->pos);
+		e->failed = true;
+		return -1;
+	}
+	Expression_Node_t node = { .kind = NODE_MATRIX, .left = -1, .right = -1 };
+	memcpy(node.name, start, len);
+	e->pos += len;
+	return add_node(e, &node);
+}
+
+/*
+ * PURPOSE: parses ~x
+ * INPUTS:
+ *	e the expression being parsed
+ * RETURN:
+ *	the index of the node, -1 on failure
+ **/
+static int parse_unary (Expression_t* e) {
+	if (accept_token(e, "~")) {
+		return add_op(e, MATRIX_OP_NOT, parse_unary(e), -1);
+	}
+	return parse_primary(e);
+}
+
+/*
+ * PURPOSE: parses x * y
+ * INPUTS:
+ *	e the expression being parsed
+ * RETURN:
+ *	the index of the node, -1 on failure
+ **/
+static int parse_product (Expression_t* e) {
+	int left = parse_unary(e);
+	while (left >= 0 && accept_token(e, "*")) {
+		left = add_op(e, MATRIX_OP_MUL, left, parse_unary(e));
+	}
+	return left;
+}
+
+/*
+ * PURPOSE: parses x + y and x - y
+ * INPUTS:
+ *	e the expression being parsed
+ * RETURN:
+ *	the index of the node, -1 on failure
+ **/
+static int parse_sum (Expression_t* e) {
+	int left = parse_product(e);
+	while (left >= 0) {
+		if (accept_token(e, "+")) {
+			left = add_op(e, MATRIX_OP_ADD, left, parse_product(e));
+		}
+		else if (accept_token(e, "-")) {
+			left = add_op(e, MATRIX_OP_SUB, left, parse_product(e));
+		}
+		else {
+			break;
+		}
+	}
+	return left;
+}
+
+/*
+ * PURPOSE: parses x << n and x >> n where n is a constant below 32
+ * INPUTS:
+ *	e the expression being parsed
+ * RETURN:
+ *	the index of the node, -1 on failure
+ **/
+static int parse_shift (Expression_t* e) {
+	int left = parse_sum(e);
+	while (left >= 0) {
+		Matrix_Op_t op;
+		if (accept_token(e, "<<")) {
+			op = MATRIX_OP_SHL_SCALAR;
+		}
+		else if (accept_token(e, ">>")) {
+			op = MATRIX_OP_SHR_SCALAR;
+		}
+		else {
+			break;
+		}
+		int right = parse_sum(e);
+		if (right < 0 || e->nodes[right].kind != NODE_CONST
+			|| e->nodes[right].value >= sizeof(unsigned int) * 8) {
+			printf("Shift amount must be a number below %zu\n", sizeof(unsigned int) * 8);
+			e->failed = true;
+			return -1;
+		}
+		const unsigned int shift = e->nodes[right].value;
+		if (e->nodes[left].kind == NODE_CONST) {
+			left = add_const(e, fold(op, e->nodes[left].value, shift));
+		}
+		else {
+			Expression_Node_t node = { .kind = NODE_OP, .op = op, .left = left, .right = -1, .value = shift };
+			left = add_node(e, &node);
+		}
+	}
+	return left;
+}
+
+/*
+ * PURPOSE: parses x & y
+ * INPUTS:
+ *	e the expression being parsed
+ * RETURN:
+ *	the index of the node, -1 on failure
+ **/
+static int parse_and (Expression_t* e) {
+	int left = parse_shift(e);
+	while (left >= 0 && accept_token(e, "&")) {
+		left = add_op(e, MATRIX_OP_AND, left, parse_shift(e));
+	}
+	return left;
+}
+
+/*
+ * PURPOSE: parses x ^ y
+ * INPUTS:
+ *	e the expression being parsed
+ * RETURN:
+ *	the index of the node, -1 on failure
+ **/
+static int parse_xor (Expression_t* e) {
+	int left = parse_and(e);
+	while (left >= 0 && accept_token(e, "^")) {
+		left = add_op(e, MATRIX_OP_XOR, left, parse_and(e));
+	}
+	return left;
+}
+
+/*
+ * PURPOSE: parses x | y, the lowest precedence operator
+ * INPUTS:
+ *	e the expression being parsed
+ * RETURN:
+ *	the index of the node, -1 on failure
+ **/
+static int parse_or (Expression_t* e) {
+	int left = parse_xor(e);
+	while (left >= 0 && accept_token(e, "|")) {
+		left = add_op(e, MATRIX_OP_OR, left, parse_xor(e));
+	}
+	return left;
+}
+
+/*
+ * PURPOSE: parses an element-wise expression over matrix names and
+ *	numbers using + - * & | ^ ~ << >> and parentheses
+ * INPUTS:
+ *	text the expression
+ *	expr where the parsed expression is returned
+ * RETURN:
+ *  If the text is a valid expression then true
+ *  else false for an error in the process.
+ *
+ **/
+bool parse_expression (const char* text, Expression_t** expr) {
+	TRACE_SCOPE("parse_expression", "parse");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!text || !expr) {
+		printf("No expression given\n");
+		return false;
+	}
+
+	Expression_t* e = calloc(1, sizeof(Expression_t));
+	if (!e) {
+		return false;
+	}
+	e->text = text;
+	e->root = parse_or(e);
+	while (isspace((unsigned char) text[e->pos])) {
+		++e->pos;
+	}
+	if (e->failed || e->root < 0 || text[e->pos] != '\0') {
+		if (!e->failed) {
+			printf("Unexpected input at position %zu\n", e->pos);
+		}
+		free(e);
+		return false;
+	}
+	e->text = NULL;
+	*expr = e;
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Lists the matrix names an expression refers to without parsing
+*		   it, so callers can tell what an eval command reads before it runs
+* Input: The expression text,
+*		 where the names go,
+*		 how many names fit there
+* Return: The number of names in the text, more than max_names if some
+*		  did not fit
+***/
+unsigned int scan_expression_names (const char* text, char names[][MATRIX_NAME_LEN],
+			unsigned int max_names) {
+	unsigned int count = 0;
+	for (size_t pos = 0; text && text[pos] != '\0';) {
+		size_t len = 0;
+		while (isalnum((unsigned char) text[pos + len]) || text[pos + len] == '_' || text[pos + len] == '.') {
+			++len;
+		}
+		if (len == 0) {
+			++pos;
+			continue;
+		}
+		/*runs starting with a digit are numbers such as 12 or 0x1f*/
+		if (!isdigit((unsigned char) text[pos]) && len < MATRIX_NAME_LEN) {
+			if (count < max_names) {
+				memset(names[count], 0, MATRIX_NAME_LEN);
+				memcpy(names[count], text + pos, len);
+			}
+			++count;
+		}
+		pos += len;
+	}
+	return count;
+}
+
+/*
+ * PURPOSE: looks up every matrix named in the expression and checks
+ *	that they all have the same dimensions
+ * INPUTS:
+ *	expr the parsed expression
+ *	mats the list of matrices
+ *	num_mats the number of matrices in the list
+ *	rows cols where the dimensions of the result are returned
+ * RETURN:
+ *  If every matrix exists with matching dimensions then true
+ *  else false for an error in the process.
+ *
+ **/
+bool bind_expression (Expression_t* expr, Matrix_t** mats, unsigned int num_mats,
+			unsigned int* rows, unsigned int* cols) {
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!expr || !mats || !rows || !cols) {
+		printf("No expression given\n");
+		return false;
+	}
+
+	bool found = false;
+	for (int i = 0; i <= expr->root; ++i) {
+		Expression_Node_t* n = &expr->nodes[i];
+		if (n->kind != NODE_MATRIX) {
+			continue;
+		}
+		int idx = find_matrix_given_name(mats, num_mats, n->name);
+		if (idx < 0) {
+			printf("Matrix (%s) doesn't exist\n", n->name);
+			return false;
+		}
+		n->matrix = mats[idx];
+		if (!found) {
+			*rows = n->matrix->rows;
+			*cols = n->matrix->cols;
+			found = true;
+		}
+		else if (n->matrix->rows != *rows || n->matrix->cols != *cols) {
+			printf("Matrix (%s) has different dimensions\n", n->name);
+			return false;
+		}
+	}
+	if (!found) {
+		printf("Expression does not use any matrix\n");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: evaluates a bound expression into a matrix in a single pass.
+ *	The values are processed in tiles of EXPR_TILE: operand tiles are read
+ *	in place from the matrices or generated into scratch tiles,
+ *	intermediates live in small scratch tiles
+ *	and the final operation writes straight into the result, which may be
+ *	one of the operands.
+ * INPUTS:
+ *	expr the bound expression
+ *	out the result matrix with the dimensions bind_expression returned
+ * RETURN:
+ *  If the expression was evaluated then true
+ *  else false for an error in the process.
+ *
+ **/
+bool evaluate_expression (Expression_t* expr, Matrix_t* out) {
+	TRACE_SCOPE("evaluate_expression", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!expr || !out || (!out->data && out->generator == MATRIX_GEN_NONE)) {
+		printf("No expression or result matrix\n");
+		return false;
+	}
+
+	const int last = expr->root;
+	bool dense = out->stride == out->cols;
+	for (int i = 0; i <= last; ++i) {
+		const Expression_Node_t* n = &expr->nodes[i];
+		if (n->kind == NODE_MATRIX) {
+			if (!n->matrix || n->matrix->rows != out->rows || n->matrix->cols != out->cols) {
+				printf("Expression is not bound to the result dimensions\n");
+				return false;
+			}
+			dense = dense && n->matrix->stride == n->matrix->cols;
+		}
+	}
+
+	/*a result overlapping an operand elsewhere is computed apart and copied in*/
+	for (int i = 0; i <= last; ++i) {
+		if (expr->nodes[i].kind == NODE_MATRIX && matrices_overlap(out, expr->nodes[i].matrix)) {
+			Matrix_t* result = NULL;
+			if (!create_matrix(&result, out->name, out->rows, out->cols)) {
+				return false;
+			}
+			const bool ok = evaluate_expression(expr, result) && duplicate_matrix(result, out);
+			destroy_matrix(&result);
+			return ok;
+		}
+	}
+
+	if (!materialize_matrix(out)) {
+		return false;
+	}
+
+	unsigned int* scratch = malloc(sizeof(unsigned int) * EXPR_TILE * (last + 1));
+	if (!scratch) {
+		printf("Failed to allocate expression tiles\n");
+		return false;
+	}
+	for (int i = 0; i <= last; ++i) {
+		if (expr->nodes[i].kind == NODE_CONST) {
+			for (unsigned int j = 0; j < EXPR_TILE; ++j) {
+				scratch[i * EXPR_TILE + j] = expr->nodes[i].value;
+			}
+		}
+	}
+
+	/* dense operands are walked as one long row */
+	const size_t rows = dense ? 1 : out->rows;
+	const size_t cols = dense ? (size_t) out->rows * out->cols : out->cols;
+	const unsigned int* tile[EXPR_MAX_NODES];
+
+	for (size_t r = 0; r < rows; ++r) {
+		for (size_t c = 0; c < cols; c += EXPR_TILE) {
+			const size_t n = cols - c < EXPR_TILE ? cols - c : EXPR_TILE;
+			unsigned int* out_tile = out->data + r * out->stride + c;
+			for (int i = 0; i <= last; ++i) {
+				const Expression_Node_t* node = &expr->nodes[i];
+				if (node->kind == NODE_MATRIX && node->matrix->data) {
+					tile[i] = node->matrix->data + r * node->matrix->stride + c;
+				}
+				else if (node->kind == NODE_MATRIX) {
+					/* generated operands are made into their scratch tile */
+					generate_matrix_values(node->matrix, r * node->matrix->cols + c, n, scratch + i * EXPR_TILE);
+					tile[i] = scratch + i * EXPR_TILE;
+				}
+				else if (node->kind == NODE_CONST) {
+					tile[i] = scratch + i * EXPR_TILE;
+				}
+				else {
+					unsigned int* dest = i == last ? out_tile : scratch + i * EXPR_TILE;
+					apply_row_operation(node->op, tile[node->left],
+							node->right >= 0 ? tile[node->right] : NULL, node->value, dest, n);
+					tile[i] = dest;
+				}
+			}
+			if (tile[last] != out_tile) {
+				memmove(out_tile, tile[last], n * sizeof(unsigned int));
+			}
+		}
+	}
+
+	free(scratch);
+	touch_matrix(out);
+	return true;
+}
+
+/*
+ * PURPOSE: frees a parsed expression
+ * INPUTS:
+ *	expr the expression, set to NULL afterwards
+ * RETURN:
+ *	void
+ *
+ **/
+void destroy_expression (Expression_t** expr) {
+	if (!expr || !(*expr)) {
+		return;
+	}
+	free(*expr);
+	*expr = NULL;
+}
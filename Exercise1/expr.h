@@ -0,0 +1,14 @@
+#ifndef _EXPR_H_
+#define _EXPR_H_
+
+typedef struct Expression Expression_t;
+
+bool parse_expression (const char* text, Expression_t** expr);
+bool bind_expression (Expression_t* expr, Matrix_t** mats, unsigned int num_mats,
+			unsigned int* rows, unsigned int* cols);
+bool evaluate_expression (Expression_t* expr, Matrix_t* out);
+void destroy_expression (Expression_t** expr);
+unsigned int scan_expression_names (const char* text, char names[][MATRIX_NAME_LEN],
+			unsigned int max_names);
+
+#endif
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <ctype.h>
 #include <limits.h>
 #include <math.h>
 #include <stdbool.h>
@@ -10,15 +12,54 @@
 
 #include "command.h"
 #include "matrix.h"
+#include "server.h"
+#include "expr.h"
+#include "trace.h"
+#include "script.h"
+
+#define MAX_EXPRESSION_LEN 1024
 
 void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats);
 unsigned int find_matrix_given_name (Matrix_t** mats, unsigned int num_mats, 
 			const char* target);
+Matrix_t* destination_matrix (Matrix_t** mats, unsigned int num_mats, const char* name,
+			unsigned int rows, unsigned int cols, bool* reused);
 
 //  complete the defintion of this function. 
 
 void destroy_remaining_heap_allocations(Matrix_t **mats, unsigned int num_mats);
 
+/*
+ * PURPOSE: reads a whole token as a decimal number no larger than max
+ * INPUTS:
+ *	text the token
+ *	max the largest value allowed
+ *	value receives the number
+ * RETURN:
+ *	true if the token is only digits and fits under max
+ **/
+static bool parse_number (const char* text, unsigned long long max, unsigned long long* value) {
+	if (!text || !isdigit((unsigned char) text[0])) {
+		return false;
+	}
+	char* end = NULL;
+	errno = 0;
+	*value = strtoull(text,&end,10);
+	return *end == '\0' && errno != ERANGE && *value <= max;
+}
+
+/*
+ * PURPOSE: prints how the program is started
+ * INPUTS:
+ *	program the name the program was started with
+ * RETURN:
+ *	void
+ **/
+static void print_usage (const char* program) {
+	printf("Usage: %s [--workspace <file>] [--budget <megabytes>] [--scratch <directory>]\n"
+			"\t[--serve <socket> | --script <file>] [--jobs <threads>]\n", program);
+}
+
 	// FUNCTION COMMENT
 /***
 * Purpose: Add a temporary matrix to the array of matrices. 
@@ -38,7 +79,7 @@ int main (int argc, char **argv) {
 		printf("Error during init. Terminating\n");
 		return -1;
 	} // ERROR CHECK
-	if (!add_matrix_to_array(mats,temp, 10)){
+	if (add_matrix_to_array(mats,temp, 10) == (unsigned int) -1){
 		printf("Could not add matrix to array\n");
 		destroy_remaining_heap_allocations(mats,10);
 		return -1;
@@ -54,6 +95,69 @@ int main (int argc, char **argv) {
 		printf("Matrix did not write to file");
 	} //  ERROR CHECK
 
+	/*restore a saved working set: --workspace <file>*/
+	const char* socket_path = NULL;
+	const char* script_path = NULL;
+	const char* jobs_arg = NULL;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i],"--workspace") == 0) {
+			if (!load_workspace(argv[i + 1],mats,10)) {
+				printf("Failed to load workspace %s\n", argv[i + 1]);
+			}
+			++i;
+		}
+		else if (strcmp(argv[i],"--serve") == 0) {
+			socket_path = argv[++i];
+		}
+		else if (strcmp(argv[i],"--script") == 0) {
+			script_path = argv[++i];
+		}
+		else if (strcmp(argv[i],"--jobs") == 0) {
+			jobs_arg = argv[++i];
+		}
+		else if (strcmp(argv[i],"--budget") == 0) {
+			unsigned long long megabytes = 0;
+			if (!parse_number(argv[i + 1],ULLONG_MAX >> 20,&megabytes)) {
+				printf("Budget must be a whole number of megabytes, 0 for no limit\n");
+				print_usage(argv[0]);
+				destroy_remaining_heap_allocations(mats,10);
+				return -1;
+			}
+			set_memory_budget(megabytes << 20);
+			++i;
+		}
+		else if (strcmp(argv[i],"--scratch") == 0) {
+			if (!set_scratch_directory(argv[i + 1])) {
+				printf("Failed to set scratch directory %s\n", argv[i + 1]);
+			}
+			++i;
+		}
+	}
+
+	/*0 or no --jobs means one worker per cpu*/
+	const unsigned int max_jobs = socket_path ? MAX_SERVER_JOBS : MAX_SCRIPT_JOBS;
+	unsigned long long jobs = 0;
+	if (jobs_arg && !parse_number(jobs_arg,max_jobs,&jobs)) {
+		printf("Jobs must be a whole number from 0 to %u, 0 for one per cpu\n", max_jobs);
+		print_usage(argv[0]);
+		destroy_remaining_heap_allocations(mats,10);
+		return -1;
+	}
+
+	/*share the matrices with other processes instead of reading stdin: --serve <socket> [--jobs <n>]*/
+	if (socket_path) {
+		bool served = serve_matrices(socket_path,mats,10,jobs);
+		destroy_remaining_heap_allocations(mats,10);
+		return served ? 0 : -1;
+	}
+
+	/*run a file of commands instead of reading stdin: --script <file> [--jobs <n>]*/
+	if (script_path) {
+		bool ran = run_script(script_path,mats,10,jobs);
+		destroy_remaining_heap_allocations(mats,10);
+		return ran ? 0 : -1;
+	}
+
 	line = readline("> ");
 	while (strncmp(line,"exit", strlen("exit")  + 1) != 0) {
 		
@@ -84,6 +188,7 @@ int main (int argc, char **argv) {
 * Return: void
 ***/
 void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
+	TRACE_SCOPE("run_commands", "command");
 	// ERROR CHECK INCOMING PARAMETERS
 	if(!cmd || !(cmd)->cmds){
 		printf("No commands found!\n");
@@ -98,6 +203,8 @@ void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
 		return;
 	}
 
+	begin_matrix_command();
+
 	/*Parsing and calling of commands*/
 	if (strncmp(cmd->cmds[0],"display",strlen("display") + 1) == 0
 		&& cmd->num_cmds == 2) {
@@ -116,43 +223,59 @@ void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
 			int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
 			int mat2_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[2]);
 			if (mat1_idx >= 0 && mat2_idx >= 0) {
-				Matrix_t* c = NULL;
-				if( !create_matrix (&c,cmd->cmds[3], mats[mat1_idx]->rows, 
-						mats[mat1_idx]->cols)) {
+				/*a row or column vector is broadcast, the result has the shape of the other matrix*/
+				const Matrix_t* shape = (size_t) mats[mat2_idx]->rows * mats[mat2_idx]->cols
+						> (size_t) mats[mat1_idx]->rows * mats[mat1_idx]->cols ? mats[mat2_idx] : mats[mat1_idx];
+				bool reused = false;
+				Matrix_t* c = destination_matrix (mats, num_mats, cmd->cmds[3],
+						shape->rows, shape->cols, &reused);
+				if (!c) {
 					printf("Failure to create the result Matrix (%s)\n", cmd->cmds[3]);
 					return;
 				}
-			
-				if (! add_matrix_to_array(mats,c, num_mats)){
-					printf("Failure to add matrix %s to the array\n", cmd->cmds[3]);
-					return;
-				} //ERROR CHECK
-
 
 				if (! add_matrices(mats[mat1_idx], mats[mat2_idx],c) ) {
 					printf("Failure to add %s with %s into %s\n", mats[mat1_idx]->name, mats[mat2_idx]->name,c->name);
+					if (!reused) {
+						destroy_matrix(&c);
+					}
 					return;	
 				}
+
+				if (add_matrix_to_array(mats,c, num_mats) == (unsigned int) -1){
+					printf("Failure to add matrix %s to the array\n", cmd->cmds[3]);
+					if (!reused) {
+						destroy_matrix(&c);
+					}
+					return;
+				} //ERROR CHECK
 			}
 	}
 	else if (strncmp(cmd->cmds[0],"duplicate",strlen("duplicate") + 1) == 0
-		&& cmd->num_cmds == 3 && strlen(cmd->cmds[1]) + 1 <= MATRIX_NAME_LEN) {
+		&& cmd->num_cmds == 3) {
 		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
 		if (mat1_idx >= 0 ) {
-				Matrix_t* dup_mat = NULL;
-				if( !create_matrix (&dup_mat,cmd->cmds[2], mats[mat1_idx]->rows, 
-						mats[mat1_idx]->cols)) {
+				bool reused = false;
+				Matrix_t* dup_mat = destination_matrix (mats, num_mats, cmd->cmds[2],
+						mats[mat1_idx]->rows, mats[mat1_idx]->cols, &reused);
+				if (!dup_mat) {
 					return;
 				}
 				if (! duplicate_matrix (mats[mat1_idx], dup_mat)){
 					printf("Failed to duplicate matrix %d.\n", mat1_idx);
+					if (!reused) {
+						destroy_matrix(&dup_mat);
+					}
 					return;
 				} //ERROR CHECK 
-				if (! add_matrix_to_array(mats,dup_mat,num_mats)){
+				printf ("Duplication of %s into %s finished\n", mats[mat1_idx]->name, cmd->cmds[2]);
+				if (add_matrix_to_array(mats,dup_mat,num_mats) == (unsigned int) -1){
 					printf("Failed to add the copy of %d to the array of matrices.\n", mat1_idx);
+					if (!reused) {
+						destroy_matrix(&dup_mat);
+					}
 					return;
 				} //ERROR CHECK 
-				printf ("Duplication of %s into %s finished\n", mats[mat1_idx]->name, cmd->cmds[2]);
 		}
 		else {
 			printf("Duplication Failed\n");
@@ -160,7 +283,7 @@ void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
 		}
 	}
 	else if (strncmp(cmd->cmds[0],"equal",strlen("equal") + 1) == 0
-		&& cmd->num_cmds == 2) {
+		&& cmd->num_cmds == 3) {
 			int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
 			int mat2_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[2]);
 			if (mat1_idx >= 0 && mat2_idx >= 0) {
@@ -177,12 +300,36 @@ void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
 			}
 	}
 	else if (strncmp(cmd->cmds[0],"shift",strlen("shift") + 1) == 0
-		&& cmd->num_cmds == 4) {
+		&& (cmd->num_cmds == 4 || cmd->num_cmds == 5)) {
 		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
 		const int shift_value = atoi(cmd->cmds[3]);
 		if (mat1_idx >= 0 ) {
-			bitwise_shift_matrix(mats[mat1_idx],cmd->cmds[2][0], shift_value); //TODO ERROR CHECK NEEDED
+			/*shift <matrix> <direction> <shifts> [destination]*/
+			bool reused = true;
+			Matrix_t* dest = mats[mat1_idx];
+			if (cmd->num_cmds == 5) {
+				dest = destination_matrix (mats, num_mats, cmd->cmds[4],
+						mats[mat1_idx]->rows, mats[mat1_idx]->cols, &reused);
+				if (!dest) {
+					printf("Matrix shift failed\n");
+					return;
+				}
+			}
+			if (! bitwise_shift_matrix_into(mats[mat1_idx],cmd->cmds[2][0], shift_value, dest)) {
+				printf("Matrix shift failed\n");
+				if (!reused) {
+					destroy_matrix(&dest);
+				}
+				return;
+			}
 			printf("Matrix (%s) has been shifted by %d\n", mats[mat1_idx]->name, shift_value);
+			if (add_matrix_to_array(mats,dest,num_mats) == (unsigned int) -1) {
+				printf("Failed to add matrix %s to the list of matrices.\n", dest->name);
+				if (!reused) {
+					destroy_matrix(&dest);
+				}
+				return;
+			}
 		}
 		else {
 			printf("Matrix shift failed\n");
@@ -190,6 +337,343 @@ void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
 		}
 
 	}
+	else if (strncmp(cmd->cmds[0],"sum",strlen("sum") + 1) == 0
+		&& cmd->num_cmds == 2) {
+		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
+		if (mat1_idx >= 0) {
+			printf("Sum of matrix (%s) is %u\n", mats[mat1_idx]->name,
+					(unsigned int) sum_matrix(mats[mat1_idx]));
+		}
+		else {
+			printf("Matrix (%s) doesn't exist\n", cmd->cmds[1]);
+			return;
+		}
+	}
+	else if (strncmp(cmd->cmds[0],"regionsum",strlen("regionsum") + 1) == 0
+		&& cmd->num_cmds == 6) {
+		/*regionsum <matrix_name> <row_start> <row_end> <col_start> <col_end>*/
+		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
+		if (mat1_idx < 0) {
+			printf("Matrix (%s) doesn't exist\n", cmd->cmds[1]);
+			return;
+		}
+		const unsigned int row_start = atoi(cmd->cmds[2]);
+		const unsigned int row_end = atoi(cmd->cmds[3]);
+		const unsigned int col_start = atoi(cmd->cmds[4]);
+		const unsigned int col_end = atoi(cmd->cmds[5]);
+		unsigned long long sum = 0;
+		if (! region_sum_matrix(mats[mat1_idx],row_start,row_end,col_start,col_end,&sum)) {
+			printf("Region sum failed\n");
+			return;
+		}
+		printf("Sum of matrix (%s) rows %u:%u cols %u:%u is %llu\n", mats[mat1_idx]->name,
+				row_start, row_end, col_start, col_end, sum);
+	}
+	else if (strncmp(cmd->cmds[0],"reduce",strlen("reduce") + 1) == 0
+		&& cmd->num_cmds == 5) {
+		/*reduce <matrix> rows|cols sum|min|max <result_matrix>*/
+		static const char* reductions[MATRIX_REDUCE_COUNT] = {
+			[MATRIX_REDUCE_SUM] = "sum", [MATRIX_REDUCE_MIN] = "min", [MATRIX_REDUCE_MAX] = "max",
+		};
+		Matrix_Reduce_t reduce = 0;
+		while (reduce < MATRIX_REDUCE_COUNT && strcmp(cmd->cmds[3],reductions[reduce]) != 0) {
+			++reduce;
+		}
+		const bool per_row = strcmp(cmd->cmds[2],"rows") == 0;
+		if (reduce == MATRIX_REDUCE_COUNT || (!per_row && strcmp(cmd->cmds[2],"cols") != 0)) {
+			printf("Usage: reduce <matrix> rows|cols sum|min|max <result_matrix>\n");
+			return;
+		}
+		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
+		if (mat1_idx < 0) {
+			printf("Matrix (%s) doesn't exist\n", cmd->cmds[1]);
+			return;
+		}
+		bool reused = false;
+		Matrix_t* out = destination_matrix (mats, num_mats, cmd->cmds[4],
+				per_row ? mats[mat1_idx]->rows : 1, per_row ? 1 : mats[mat1_idx]->cols, &reused);
+		if (!out || ! reduce_matrix(mats[mat1_idx], per_row, reduce, out)) {
+			printf("Reduce Failed\n");
+			if (out && !reused) {
+				destroy_matrix(&out);
+			}
+			return;
+		}
+		if (add_matrix_to_array(mats,out,num_mats) == (unsigned int) -1) {
+			printf("Failure to add matrix %s to the array\n", cmd->cmds[4]);
+			if (!reused) {
+				destroy_matrix(&out);
+			}
+			return;
+		}
+		printf("Matrix (%s) holds the %s of every %s of %s\n", out->name, cmd->cmds[3],
+				per_row ? "row" : "col", cmd->cmds[1]);
+	}
+	else if (strncmp(cmd->cmds[0],"histogram",strlen("histogram") + 1) == 0
+		&& cmd->num_cmds == 3) {
+		/*histogram <matrix> <bins>*/
+		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
+		const unsigned int bins = strtoul(cmd->cmds[2],NULL,10);
+		unsigned long long* counts = calloc(bins + 1, sizeof(unsigned long long));
+		unsigned long long* edges = calloc(bins + 1, sizeof(unsigned long long));
+		if (mat1_idx < 0 || !counts || !edges || ! histogram_matrix(mats[mat1_idx], bins, counts, edges)) {
+			printf("Histogram Failed\n");
+			free(counts);
+			free(edges);
+			return;
+		}
+		printf("Histogram of matrix (%s):\n", mats[mat1_idx]->name);
+		for (unsigned int b = 0; b < bins; ++b) {
+			if (edges[b] < edges[b + 1]) {
+				printf("[%llu, %llu] %llu\n", edges[b], edges[b + 1] - 1, counts[b]);
+			}
+		}
+		free(counts);
+		free(edges);
+	}
+	else if (strncmp(cmd->cmds[0],"topk",strlen("topk") + 1) == 0
+		&& cmd->num_cmds == 3) {
+		/*topk <matrix> <k>*/
+		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
+		const unsigned int k = strtoul(cmd->cmds[2],NULL,10);
+		/*k is checked before the results are allocated for it*/
+		if (mat1_idx < 0 || k == 0 || k > (unsigned long long) mats[mat1_idx]->rows * mats[mat1_idx]->cols) {
+			if (mat1_idx >= 0) {
+				printf("k must be between 1 and the number of values\n");
+			}
+			printf("Top k Failed\n");
+			return;
+		}
+		unsigned int* values = calloc((size_t) k * 3, sizeof(unsigned int));
+		if (!values || ! topk_matrix(mats[mat1_idx], k, values, values + k, values + 2 * (size_t) k)) {
+			printf("Top k Failed\n");
+			free(values);
+			return;
+		}
+		printf("Top %u values of matrix (%s):\n", k, mats[mat1_idx]->name);
+		for (unsigned int i = 0; i < k; ++i) {
+			printf("%u at (%u,%u)\n", values[i], values[k + i], values[2 * k + i]);
+		}
+		free(values);
+	}
+	else if (strncmp(cmd->cmds[0],"sortrows",strlen("sortrows") + 1) == 0
+		&& cmd->num_cmds == 3) {
+		/*sortrows <matrix> <col>*/
+		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
+		const unsigned int col = strtoul(cmd->cmds[2],NULL,10);
+		if (mat1_idx < 0 || ! sort_rows_matrix(mats[mat1_idx], col)) {
+			printf("Sort Failed\n");
+			return;
+		}
+		printf("Matrix (%s) rows are sorted by column %u\n", mats[mat1_idx]->name, col);
+	}
+	else if (strncmp(cmd->cmds[0],"budget",strlen("budget") + 1) == 0
+		&& (cmd->num_cmds == 2 || cmd->num_cmds == 3)) {
+		/*budget <megabytes> [scratch_directory]*/
+		unsigned long long megabytes = 0;
+		if (!parse_number(cmd->cmds[1],ULLONG_MAX >> 20,&megabytes)) {
+			printf("Budget must be a whole number of megabytes, 0 for no limit\n");
+			return;
+		}
+		if (cmd->num_cmds == 3 && ! set_scratch_directory(cmd->cmds[2])) {
+			printf("Budget Failed\n");
+			return;
+		}
+		set_memory_budget(megabytes << 20);
+		printf("Matrix memory budget is %llu MB\n", megabytes);
+	}
+	else if (strncmp(cmd->cmds[0],"trace",strlen("trace") + 1) == 0
+		&& ((cmd->num_cmds == 3 && strcmp(cmd->cmds[1],"on") == 0)
+			|| (cmd->num_cmds == 2 && strcmp(cmd->cmds[1],"off") == 0))) {
+		/*trace on <file> | trace off*/
+		if (cmd->num_cmds == 3) {
+			if (! start_trace(cmd->cmds[2])) {
+				printf("Trace Failed\n");
+				return;
+			}
+			printf("Tracing into %s\n", cmd->cmds[2]);
+		}
+		else {
+			if (! stop_trace()) {
+				printf("Trace Failed\n");
+				return;
+			}
+			printf("Tracing stopped\n");
+		}
+	}
+	else if (strncmp(cmd->cmds[0],"convolve",strlen("convolve") + 1) == 0
+		&& (cmd->num_cmds == 4 || cmd->num_cmds == 5)) {
+		/*convolve <src> <kernel> <dst> [zero|clamp|wrap]*/
+		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
+		int mat2_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[2]);
+		Matrix_Border_t border = MATRIX_BORDER_ZERO;
+		if (cmd->num_cmds == 5) {
+			border = strcmp(cmd->cmds[4],"zero") == 0 ? MATRIX_BORDER_ZERO
+				: strcmp(cmd->cmds[4],"clamp") == 0 ? MATRIX_BORDER_CLAMP
+				: strcmp(cmd->cmds[4],"wrap") == 0 ? MATRIX_BORDER_WRAP : (Matrix_Border_t) -1;
+		}
+		if (mat1_idx < 0 || mat2_idx < 0 || border == (Matrix_Border_t) -1) {
+			printf("Convolve Failed\n");
+			return;
+		}
+		bool reused = false;
+		Matrix_t* dst = destination_matrix (mats, num_mats, cmd->cmds[3],
+				mats[mat1_idx]->rows, mats[mat1_idx]->cols, &reused);
+		if (!dst) {
+			printf("Convolve Failed\n");
+			return;
+		}
+		if (! convolve_matrix(mats[mat1_idx], mats[mat2_idx], border, dst)) {
+			printf("Convolve Failed\n");
+			if (!reused) {
+				destroy_matrix(&dst);
+			}
+			return;
+		}
+		printf("Matrix (%s) is %s convolved with %s\n", dst->name, mats[mat1_idx]->name, mats[mat2_idx]->name);
+		if (add_matrix_to_array(mats,dst,num_mats) == (unsigned int) -1) {
+			printf("Failed to add matrix %s to the list of matrices.\n", dst->name);
+			if (!reused) {
+				destroy_matrix(&dst);
+			}
+			return;
+		}
+	}
+	else if (strncmp(cmd->cmds[0],"view",strlen("view") + 1) == 0
+		&& cmd->num_cmds == 5) {
+		/*view <view_name> <matrix_name> <row_start>:<row_end> <col_start>:<col_end>*/
+		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[2]);
+		unsigned int row_start = 0, row_end = 0, col_start = 0, col_end = 0;
+		if (mat1_idx < 0
+			|| sscanf(cmd->cmds[3],"%u:%u",&row_start,&row_end) != 2
+			|| sscanf(cmd->cmds[4],"%u:%u",&col_start,&col_end) != 2) {
+			printf("View Failed\n");
+			return;
+		}
+		Matrix_t* view = NULL;
+		if (! create_view(&view,cmd->cmds[1],mats[mat1_idx],row_start,row_end,col_start,col_end)) {
+			printf("Failed to create view %s.\n", cmd->cmds[1]);
+			return;
+		}
+		if (add_matrix_to_array(mats,view,num_mats) == (unsigned int) -1) {
+			printf("Failed to add view %s to the list of matrices.\n", cmd->cmds[1]);
+			destroy_matrix(&view);
+			return;
+		}
+		printf("Created View (%s,%u,%u) of %s\n", view->name, view->rows, view->cols, view->parent->name);
+	}
+	else if (strncmp(cmd->cmds[0],"op",strlen("op") + 1) == 0
+		&& (cmd->num_cmds == 4 || cmd->num_cmds == 5)) {
+		/*op <operation> <matrix_name> [<matrix_name>|<scalar>] <result_matrix_name>*/
+		static const struct {
+			const char* name;
+			Matrix_Op_t op;
+		} operations[] = {
+			{"add", MATRIX_OP_ADD}, {"sub", MATRIX_OP_SUB}, {"mul", MATRIX_OP_MUL},
+			{"and", MATRIX_OP_AND}, {"or", MATRIX_OP_OR}, {"xor", MATRIX_OP_XOR},
+			{"not", MATRIX_OP_NOT}, {"sadd", MATRIX_OP_ADD_SCALAR}, {"smul", MATRIX_OP_MUL_SCALAR},
+			{"shl", MATRIX_OP_SHL_SCALAR}, {"shr", MATRIX_OP_SHR_SCALAR},
+		};
+		int op_idx = -1;
+		for (int i = 0; i < sizeof(operations) / sizeof(operations[0]); ++i) {
+			if (strcmp(cmd->cmds[1],operations[i].name) == 0) {
+				op_idx = i;
+			}
+		}
+		const bool unary = op_idx >= 0 && operations[op_idx].op == MATRIX_OP_NOT;
+		if (op_idx < 0 || cmd->num_cmds != (unary ? 4 : 5)) {
+			printf("Unknown operation %s\n", cmd->cmds[1]);
+			return;
+		}
+		const Matrix_Op_t op = operations[op_idx].op;
+		const char* result_name = cmd->cmds[cmd->num_cmds - 1];
+		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[2]);
+		int mat2_idx = -1;
+		if (op < MATRIX_OP_ADD_SCALAR && !unary) {
+			mat2_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[3]);
+			if (mat2_idx < 0) {
+				printf("Matrix (%s) doesn't exist\n", cmd->cmds[3]);
+				return;
+			}
+		}
+		if (mat1_idx < 0) {
+			printf("Matrix (%s) doesn't exist\n", cmd->cmds[2]);
+			return;
+		}
+
+		bool reused = false;
+		Matrix_t* c = destination_matrix (mats, num_mats, result_name,
+				mats[mat1_idx]->rows, mats[mat1_idx]->cols, &reused);
+		if (!c) {
+			printf("Failure to create the result Matrix (%s)\n", result_name);
+			return;
+		}
+		bool done;
+		if (op >= MATRIX_OP_ADD_SCALAR) {
+			done = scalar_matrix(op, mats[mat1_idx], strtoul(cmd->cmds[3],NULL,10), c);
+		}
+		else {
+			done = elementwise_matrices(op, mats[mat1_idx], unary ? NULL : mats[mat2_idx], c);
+		}
+		if (!done) {
+			printf("Operation %s failed\n", cmd->cmds[1]);
+			if (!reused) {
+				destroy_matrix(&c);
+			}
+			return;
+		}
+		if (add_matrix_to_array(mats,c,num_mats) == (unsigned int) -1) {
+			printf("Failure to add matrix %s to the array\n", result_name);
+			if (!reused) {
+				destroy_matrix(&c);
+			}
+			return;
+		}
+		printf("Matrix (%s) is %s of the operands\n", c->name, operations[op_idx].name);
+	}
+	else if (strncmp(cmd->cmds[0],"eval",strlen("eval") + 1) == 0
+		&& cmd->num_cmds >= 4 && strcmp(cmd->cmds[2],"=") == 0) {
+		/*eval <matrix_result_name> = <expression>*/
+		char text[MAX_EXPRESSION_LEN] = "";
+		size_t len = 0;
+		for (int i = 3; i < cmd->num_cmds; ++i) {
+			len += snprintf(text + len, sizeof(text) - len, "%s ", cmd->cmds[i]);
+			if (len >= sizeof(text)) {
+				printf("Expression is too long\n");
+				return;
+			}
+		}
+		Expression_t* expr = NULL;
+		unsigned int rows = 0, cols = 0;
+		if (! parse_expression(text,&expr)) {
+			printf("Eval Failed\n");
+			return;
+		}
+		if (! bind_expression(expr,mats,num_mats,&rows,&cols)) {
+			printf("Eval Failed\n");
+			destroy_expression(&expr);
+			return;
+		}
+		bool reused = false;
+		Matrix_t* out = destination_matrix (mats, num_mats, cmd->cmds[1], rows, cols, &reused);
+		if (!out || ! evaluate_expression(expr,out)) {
+			printf("Eval Failed\n");
+			if (out && !reused) {
+				destroy_matrix(&out);
+			}
+			destroy_expression(&expr);
+			return;
+		}
+		destroy_expression(&expr);
+		if (add_matrix_to_array(mats,out,num_mats) == (unsigned int) -1) {
+			printf("Failure to add matrix %s to the array\n", cmd->cmds[1]);
+			if (!reused) {
+				destroy_matrix(&out);
+			}
+			return;
+		}
+		printf("Matrix (%s) is evaluated\n", out->name);
+	}
 	else if (strncmp(cmd->cmds[0],"read",strlen("read") + 1) == 0
 		&& cmd->num_cmds == 2) {
 		Matrix_t* new_matrix = NULL;
@@ -198,7 +682,7 @@ void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
 			return;
 		}	
 		
-		if (! add_matrix_to_array(mats,new_matrix, num_mats)){
+		if (add_matrix_to_array(mats,new_matrix, num_mats) == (unsigned int) -1){
 			printf("Matrix %s could not be added to the list of matrices.\n", cmd->cmds[1]);
 			return;
 		}// ERROR CHECK 
@@ -215,8 +699,43 @@ void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
 			printf("Matrix (%s) is wrote out to the filesystem\n", mats[mat1_idx]->name);
 		}
 	}
+	else if (strncmp(cmd->cmds[0],"fadd",strlen("fadd") + 1) == 0
+		&& cmd->num_cmds == 4) {
+		/*fadd <file> <file> <output file>*/
+		if (! stream_matrix_files(MATRIX_OP_ADD, cmd->cmds[1], cmd->cmds[2], 0, cmd->cmds[3])) {
+			printf("File add failed\n");
+			return;
+		}
+		printf("Files %s and %s are added into %s\n", cmd->cmds[1], cmd->cmds[2], cmd->cmds[3]);
+	}
+	else if (strncmp(cmd->cmds[0],"fshift",strlen("fshift") + 1) == 0
+		&& cmd->num_cmds == 5) {
+		/*fshift <file> <direction> <shifts> <output file>*/
+		const int shift_value = atoi(cmd->cmds[3]);
+		const char direction = cmd->cmds[2][0];
+		if ((direction != 'l' && direction != 'r') || cmd->cmds[2][1] != '\0'
+			|| shift_value < 0 || shift_value >= (int) (sizeof(unsigned int) * 8)) {
+			printf("Invalid shift\n");
+			return;
+		}
+		if (! stream_matrix_files(direction == 'l' ? MATRIX_OP_SHL_SCALAR : MATRIX_OP_SHR_SCALAR,
+				cmd->cmds[1], NULL, shift_value, cmd->cmds[4])) {
+			printf("File shift failed\n");
+			return;
+		}
+		printf("File %s is shifted by %d into %s\n", cmd->cmds[1], shift_value, cmd->cmds[4]);
+	}
+	else if (strncmp(cmd->cmds[0],"verify",strlen("verify") + 1) == 0
+		&& cmd->num_cmds >= 2) {
+		/*verify <file> [file ...]*/
+		if (! verify_matrix_files(cmd->cmds + 1, cmd->num_cmds - 1)) {
+			printf("Verify Failed\n");
+			return;
+		}
+		printf("All files are intact\n");
+	}
 	else if (strncmp(cmd->cmds[0], "create", strlen("create") + 1) == 0
-		&& strlen(cmd->cmds[1]) + 1 <= MATRIX_NAME_LEN && cmd->num_cmds == 4) {
+		&& cmd->num_cmds == 4) {
 		Matrix_t* new_mat = NULL;
 		const unsigned int rows = atoi(cmd->cmds[2]);
 		const unsigned int cols = atoi(cmd->cmds[3]);
@@ -225,12 +744,64 @@ void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
 			printf("Failed to create matrix %s.\n", cmd->cmds[1]);
 			return;
 		} // ERROR CHECK 
-		if (! add_matrix_to_array(mats,new_mat,num_mats)){
+		if (add_matrix_to_array(mats,new_mat,num_mats) == (unsigned int) -1){
 			printf("Failed to add matrix %s to the list of matrices.\n", cmd->cmds[1]);
 			return;
 		} //  ERROR CHECK 
 		printf("Created Matrix (%s,%u,%u)\n", new_mat->name, new_mat->rows, new_mat->cols);
 	}
+	else if (strncmp(cmd->cmds[0], "gen", strlen("gen") + 1) == 0
+		&& (cmd->num_cmds == 5 || cmd->num_cmds == 6)) {
+		/*gen <name> <rows> <cols> random [seed=<n>] | identity | const <value> | range [<start>]*/
+		unsigned long long rows = 0;
+		unsigned long long cols = 0;
+		if (!parse_number(cmd->cmds[2],UINT_MAX,&rows) || !parse_number(cmd->cmds[3],UINT_MAX,&cols)
+			|| rows == 0 || cols == 0) {
+			printf("Rows and cols must be whole numbers from 1 to %u\n", UINT_MAX);
+			printf("Failed to generate matrix %s.\n", cmd->cmds[1]);
+			return;
+		}
+		const char* param = cmd->num_cmds == 6 ? cmd->cmds[5] : NULL;
+		Matrix_Gen_t generator = MATRIX_GEN_NONE;
+		unsigned long long value = 0;
+		bool valid = true;
+		if (strcmp(cmd->cmds[4],"random") == 0) {
+			generator = MATRIX_GEN_RANDOM;
+			if (param && strncmp(param,"seed=",strlen("seed=")) == 0) {
+				param += strlen("seed=");
+			}
+			value = (unsigned long long) rand();
+			valid = !param || parse_number(param,ULLONG_MAX,&value);
+		}
+		else if (strcmp(cmd->cmds[4],"identity") == 0 && !param) {
+			generator = MATRIX_GEN_IDENTITY;
+		}
+		else if (strcmp(cmd->cmds[4],"const") == 0 && param) {
+			generator = MATRIX_GEN_CONST;
+			valid = parse_number(param,UINT_MAX,&value);
+		}
+		else if (strcmp(cmd->cmds[4],"range") == 0) {
+			generator = MATRIX_GEN_RANGE;
+			valid = !param || parse_number(param,UINT_MAX,&value);
+		}
+		if (!valid) {
+			printf("%s is not a valid %s parameter\n", param, cmd->cmds[4]);
+			printf("Failed to generate matrix %s.\n", cmd->cmds[1]);
+			return;
+		}
+
+		Matrix_t* new_mat = NULL;
+		if (generator == MATRIX_GEN_NONE || ! generate_matrix(&new_mat,cmd->cmds[1],rows,cols,generator,value)) {
+			printf("Failed to generate matrix %s.\n", cmd->cmds[1]);
+			return;
+		}
+		if (add_matrix_to_array(mats,new_mat,num_mats) == (unsigned int) -1) {
+			printf("Failed to add matrix %s to the list of matrices.\n", cmd->cmds[1]);
+			destroy_matrix(&new_mat);
+			return;
+		}
+		printf("Generated Matrix (%s,%u,%u) %s\n", new_mat->name, new_mat->rows, new_mat->cols, cmd->cmds[4]);
+	}
 	else if (strncmp(cmd->cmds[0], "random", strlen("random") + 1) == 0
 		&& cmd->num_cmds == 4) {
 		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
@@ -240,6 +811,22 @@ void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
 
 		printf("Matrix (%s) is randomized between %u %u\n", mats[mat1_idx]->name, start_range, end_range);
 	}
+	else if (strncmp(cmd->cmds[0], "save_workspace", strlen("save_workspace") + 1) == 0
+		&& cmd->num_cmds == 2) {
+		if (! save_workspace(cmd->cmds[1],mats,num_mats)) {
+			printf("Workspace save failed\n");
+			return;
+		}
+		printf("Workspace is saved to %s\n", cmd->cmds[1]);
+	}
+	else if (strncmp(cmd->cmds[0], "load_workspace", strlen("load_workspace") + 1) == 0
+		&& cmd->num_cmds == 2) {
+		if (! load_workspace(cmd->cmds[1],mats,num_mats)) {
+			printf("Workspace load failed\n");
+			return;
+		}
+		printf("Workspace is loaded from %s\n", cmd->cmds[1]);
+	}
 	else {
 		printf("Not a command in this application\n");
 	}
@@ -248,15 +835,17 @@ void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
 
 	// FUNCTION COMMENT
 /***
-* Purpose: Finds the name of a matrix based upon the user input
+* Purpose: Finds the name of a matrix based upon the user input. Spilled
+*		   data is read back and overflowed matrices return to the array
 * Input: The array of matrices,
 * 		 the number of matrices,
 *		 the name of the matrix the user wants to find
 * Return: Where the matrix is in the array if successful, if fails then -1
 ***/ 
 unsigned int find_matrix_given_name (Matrix_t** mats, unsigned int num_mats, const char* target) {
+	TRACE_SCOPE("find_matrix_given_name", "lookup");
 	// ERROR CHECK INCOMING PARAMETERS
-	if(!(*mats) || !mats){
+	if(!mats){
 		printf("No matrices found\n");
 		return -1;
 	}
@@ -269,12 +858,66 @@ unsigned int find_matrix_given_name (Matrix_t** mats, unsigned int num_mats, con
 		return -1;
 	}
 	
+	/*a script may run other commands on other threads*/
+	lock_matrices();
 	for (int i = 0; i < num_mats; ++i) {
-		if (strncmp(mats[i]->name,target,strlen(mats[i]->name)) == 0) {
-			return i;
+		if (mats[i] && strncmp(mats[i]->name,target,MATRIX_NAME_LEN) == 0) {
+			const bool used = use_matrix(mats,num_mats,mats[i]);
+			unlock_matrices();
+			return used ? i : -1;
+		}
+	}
+
+	/*matrices pushed out of a full array come back into it*/
+	Matrix_t* overflowed = take_overflow_matrix(target);
+	unsigned int idx = -1;
+	if (overflowed) {
+		if (!use_matrix(mats,num_mats,overflowed)) {
+			destroy_matrix(&overflowed);
 		}
+		else {
+			idx = add_matrix_to_array(mats,overflowed,num_mats);
+			if (idx == (unsigned int) -1) {
+				return_overflow_matrix(overflowed);
+			}
+		}
+	}
+	unlock_matrices();
+	return idx;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Finds the matrix a command should write its result into. A
+*		   registered matrix with that name and shape is reused so no
+*		   memory is allocated, otherwise a new unregistered matrix is
+*		   created for the caller to add to the array of matrices
+* Input: The array of matrices,
+* 		 the number of matrices,
+*		 the name of the result matrix,
+*		 the rows and cols the result needs,
+*		 set to true if an existing matrix was returned
+* Return: The destination matrix, NULL if it could not be created
+***/
+Matrix_t* destination_matrix (Matrix_t** mats, unsigned int num_mats, const char* name,
+			unsigned int rows, unsigned int cols, bool* reused) {
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!mats || !name || !reused) {
+		printf("No destination matrix\n");
+		return NULL;
 	}
-	return -1;
+
+	int idx = find_matrix_given_name(mats,num_mats,name);
+	if (idx >= 0 && mats[idx]->rows == rows && mats[idx]->cols == cols) {
+		*reused = true;
+		return mats[idx];
+	}
+	*reused = false;
+	Matrix_t* m = NULL;
+	if (!create_matrix(&m,name,rows,cols)) {
+		return NULL;
+	}
+	return m;
 }
 
 	// FUNCTION COMMENT
@@ -304,15 +947,9 @@ void destroy_remaining_heap_allocations(Matrix_t **mats, unsigned int num_mats)
 			printf("No matrix at %d\n", i+1);
 		}
 		else{
-			if(!(*mats+i)->data){
-				printf("No data found in matrix %d. Freeing matrix %d\n", i+1);
-				free(*(mats+i));
-			}
-			else{
-				free((*mats+i)->data);
-				free(*(mats+i));
-				*(mats+i) = NULL;
-			}
-		}	
+			destroy_matrix(mats+i);
+		}
 	}
+	destroy_overflow_matrices();
+	destroy_trace();
 }
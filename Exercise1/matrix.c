@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,548 +9,4049 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CRC32C_HARDWARE
+#endif
 
 
 #include "matrix.h"
+#include "trace.h"
 
 
 #define MAX_CMD_COUNT 50
 
+/* matrices with at most this many elements keep data inline after the header */
+#define MATRIX_INLINE_ELEMENTS 64
+
+/* work below this many elements is not worth starting threads for */
+#define PARALLEL_MIN_ELEMENTS (1 << 18)
+#define MAX_THREADS 64
+
+/* copy buffer for moving spilled data into a workspace archive */
+#define SPILL_COPY_CHUNK (1 << 20)
+
+/* streaming file commands hold STREAM_SLOTS chunks of each operand */
+#define STREAM_CHUNK_ELEMENTS (1 << 18)
+#define STREAM_SLOTS 3
+
+/* values made per call when a generated matrix is read a piece at a time */
+#define GENERATE_TILE_ELEMENTS 1024
+
+/* workspace archive layout: header, index of entries, aligned payloads */
+#define WORKSPACE_MAGIC "MATWS02"
+/* older archives whose entries end before the generator fields */
+#define WORKSPACE_MAGIC_V1 "MATWS01"
+#define WORKSPACE_ALIGN 64
+
+typedef struct {
+	char magic[8];
+	unsigned int count;
+	unsigned int reserved;
+} Workspace_Header_t;
+
+typedef struct {
+	char name[32];
+	unsigned int rows;
+	unsigned int cols;
+	unsigned long long offset;
+	unsigned int generator;	/* Matrix_Gen_t, generated entries have no payload */
+	unsigned int reserved;
+	unsigned long long gen_param;
+} Workspace_Entry_t;
+
 /*protected functions*/
 void load_matrix (Matrix_t* m, unsigned int* data);
 
-/* 
- * PURPOSE: instantiates a new matrix with the passed name, rows, cols 
- * INPUTS: 
- *	name the name of the matrix limited to 50 characters 
- *  rows the number of rows the matrix
- *  cols the number of cols the matrix
+/*
+ * Memory budget state. Matrices evicted from a full list of matrices wait
+ * on the overflow list. Whenever resident data exceeds the budget the least
+ * recently used matrices are spilled to files in the scratch directory.
+ * Matrices used since begin_matrix_command are pinned and never evicted;
+ * while commands run side by side (see hold_matrix_pins) each of them
+ * records the matrices it uses and those stay pinned until it is released.
+ * The registry lock guards the lists, the clocks, the pins and spilling;
+ * the matrix data is left to callers.
+ */
+static unsigned long long memory_budget = 0;	/* bytes, 0 means unlimited */
+static char scratch_dir[PATH_MAX - 64] = "/tmp";
+static unsigned long long lru_clock = 0;
+static unsigned long long pin_clock = 0;
+static Matrix_Pin_t* pins = NULL;
+static __thread Matrix_Pin_t* thread_pin = NULL;	/* the held command this thread runs */
+static Matrix_t* overflow = NULL;
+static pthread_mutex_t registry_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+/*
+ * Fixed shape kernels. The element count is a compile time constant so
+ * the loops are fully unrolled and no shape arithmetic happens per call.
+ */
+typedef struct {
+	unsigned int rows;
+	unsigned int cols;
+	void (*add) (const unsigned int* a, const unsigned int* b, unsigned int* c);
+	bool (*equal) (const unsigned int* a, const unsigned int* b);
+	void (*copy) (const unsigned int* src, unsigned int* dest);
+} Small_Kernels_t;
+
+#define SMALL_KERNELS(R,C) \
+static void add_##R##x##C (const unsigned int* a, const unsigned int* b, unsigned int* c) { \
+	_Pragma("GCC unroll 64") \
+	for (unsigned int i = 0; i < (R) * (C); ++i) { \
+		c[i] = a[i] + b[i]; \
+	} \
+} \
+static bool equal_##R##x##C (const unsigned int* a, const unsigned int* b) { \
+	unsigned int diff = 0; \
+	_Pragma("GCC unroll 64") \
+	for (unsigned int i = 0; i < (R) * (C); ++i) { \
+		diff |= a[i] ^ b[i]; \
+	} \
+	return diff == 0; \
+} \
+static void copy_##R##x##C (const unsigned int* src, unsigned int* dest) { \
+	memcpy(dest, src, sizeof(unsigned int) * (R) * (C)); \
+}
+
+SMALL_KERNELS(2,2)
+SMALL_KERNELS(3,3)
+SMALL_KERNELS(4,4)
+SMALL_KERNELS(8,8)
+
+#define SMALL_KERNEL_ENTRY(R,C) { R, C, add_##R##x##C, equal_##R##x##C, copy_##R##x##C }
+
+static const Small_Kernels_t small_kernels[] = {
+	SMALL_KERNEL_ENTRY(2,2),
+	SMALL_KERNEL_ENTRY(3,3),
+	SMALL_KERNEL_ENTRY(4,4),
+	SMALL_KERNEL_ENTRY(8,8),
+};
+
+/*
+ * Element-wise row kernels written with GCC vector extensions so they
+ * compile to SSE2/AVX2 on x86 and NEON on ARM. On x86-64 an AVX2 clone is
+ * picked at load time when the CPU supports it. The scalar tail uses the
+ * same expression on plain unsigned ints.
+ */
+typedef unsigned int Vec_u32_t __attribute__((vector_size(32)));
+#define VEC_LANES (sizeof(Vec_u32_t) / sizeof(unsigned int))
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define SIMD_CLONES __attribute__((target_clones("avx2","default")))
+#else
+#define SIMD_CLONES
+#endif
+
+typedef void (*Row_Kernel_t) (const unsigned int* a, const unsigned int* b, unsigned int s,
+			unsigned int* c, size_t n);
+
+#define ROW_KERNEL(NAME, EXPR) \
+static SIMD_CLONES void NAME (const unsigned int* a, const unsigned int* b, unsigned int s, \
+			unsigned int* c, size_t n) { \
+	size_t j = 0; \
+	for (; j + VEC_LANES <= n; j += VEC_LANES) { \
+		Vec_u32_t x, y; \
+		memcpy(&x, a + j, sizeof(x)); \
+		memcpy(&y, b + j, sizeof(y)); \
+		(void) y; \
+		Vec_u32_t r = (EXPR); \
+		memcpy(c + j, &r, sizeof(r)); \
+	} \
+	for (; j < n; ++j) { \
+		unsigned int x = a[j]; \
+		unsigned int y = b[j]; \
+		(void) y; \
+		c[j] = (EXPR); \
+	} \
+	(void) s; \
+}
+
+ROW_KERNEL(row_add, x + y)
+ROW_KERNEL(row_sub, x - y)
+ROW_KERNEL(row_mul, x * y)
+ROW_KERNEL(row_and, x & y)
+ROW_KERNEL(row_or, x | y)
+ROW_KERNEL(row_xor, x ^ y)
+ROW_KERNEL(row_not, ~x)
+ROW_KERNEL(row_add_scalar, x + s)
+ROW_KERNEL(row_mul_scalar, x * s)
+ROW_KERNEL(row_shl_scalar, x << s)
+ROW_KERNEL(row_shr_scalar, x >> s)
+
+/* keeps the value of a or b that wins the comparison, for min and max */
+#define ROW_SELECT_KERNEL(NAME, CMP) \
+static SIMD_CLONES void NAME (const unsigned int* a, const unsigned int* b, unsigned int s, \
+			unsigned int* c, size_t n) { \
+	size_t j = 0; \
+	for (; j + VEC_LANES <= n; j += VEC_LANES) { \
+		Vec_u32_t x, y; \
+		memcpy(&x, a + j, sizeof(x)); \
+		memcpy(&y, b + j, sizeof(y)); \
+		const Vec_u32_t keep = (Vec_u32_t) (x CMP y); \
+		Vec_u32_t r = (x & keep) | (y & ~keep); \
+		memcpy(c + j, &r, sizeof(r)); \
+	} \
+	for (; j < n; ++j) { \
+		c[j] = a[j] CMP b[j] ? a[j] : b[j]; \
+	} \
+	(void) s; \
+}
+
+ROW_SELECT_KERNEL(row_min, <)
+ROW_SELECT_KERNEL(row_max, >)
+
+static const Row_Kernel_t reduce_kernels[MATRIX_REDUCE_COUNT] = {
+	[MATRIX_REDUCE_SUM] = row_add,
+	[MATRIX_REDUCE_MIN] = row_min,
+	[MATRIX_REDUCE_MAX] = row_max,
+};
+
+static const Row_Kernel_t row_kernels[MATRIX_OP_COUNT] = {
+	[MATRIX_OP_ADD] = row_add,
+	[MATRIX_OP_SUB] = row_sub,
+	[MATRIX_OP_MUL] = row_mul,
+	[MATRIX_OP_AND] = row_and,
+	[MATRIX_OP_OR] = row_or,
+	[MATRIX_OP_XOR] = row_xor,
+	[MATRIX_OP_NOT] = row_not,
+	[MATRIX_OP_ADD_SCALAR] = row_add_scalar,
+	[MATRIX_OP_MUL_SCALAR] = row_mul_scalar,
+	[MATRIX_OP_SHL_SCALAR] = row_shl_scalar,
+	[MATRIX_OP_SHR_SCALAR] = row_shr_scalar,
+};
+
+/*
+ * PURPOSE: looks up the fixed shape kernels for a rows x cols matrix
+ * INPUTS:
+ *	rows the number of rows of every operand
+ *	cols the number of cols of every operand
+ * RETURN:
+ *	the kernel table entry for the shape or NULL when the generic
+ *	loops have to be used
+ **/
+static const Small_Kernels_t* find_small_kernels (const unsigned int rows, const unsigned int cols) {
+	for (unsigned int i = 0; i < sizeof(small_kernels) / sizeof(small_kernels[0]); ++i) {
+		if (small_kernels[i].rows == rows && small_kernels[i].cols == cols) {
+			return &small_kernels[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * PURPOSE: tells whether the matrix data shares the header allocation
+ * INPUTS:
+ *	m the matrix to check
+ * RETURN:
+ *	true if data must not be freed on its own
+ **/
+static bool has_inline_data (const Matrix_t* m) {
+	return m->data == (const unsigned int*) (m + 1);
+}
+
+/*
+ * PURPOSE: tells whether the matrix rows follow each other without gaps,
+ *	which is true for every matrix except views of part of a row
+ * INPUTS:
+ *	m the matrix to check
+ * RETURN:
+ *	true if the data is one dense block of rows * cols elements
+ **/
+static bool is_dense (const Matrix_t* m) {
+	return m->stride == m->cols || m->rows <= 1;
+}
+
+/*
+ * PURPOSE: mixes a seed and a position into a well spread 32 bit value,
+ *	the splitmix64 finalizer, so any value can be made without the ones before it
+ * INPUTS:
+ *	seed the seed of the generator
+ *	index the position of the value in the matrix
+ * RETURN:
+ *	the value
+ **/
+static unsigned int random_value (unsigned long long seed, unsigned long long index) {
+	unsigned long long z = seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return (unsigned int) ((z ^ (z >> 31)) >> 32);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Makes a run of values of a generated matrix, counting positions
+*		   row after row from the top left value
+* Input: The generated matrix,
+*		 the position of the first value,
+*		 the number of values,
+*		 where the values go
+* Return: void
+***/
+void generate_matrix_values (const Matrix_t* m, unsigned long long first, size_t count,
+			unsigned int* values) {
+	if (m->generator == MATRIX_GEN_RANDOM) {
+		for (size_t t = 0; t < count; ++t) {
+			values[t] = random_value(m->gen_param, first + t);
+		}
+	}
+	else if (m->generator == MATRIX_GEN_CONST) {
+		for (size_t t = 0; t < count; ++t) {
+			values[t] = (unsigned int) m->gen_param;
+		}
+	}
+	else if (m->generator == MATRIX_GEN_RANGE) {
+		for (size_t t = 0; t < count; ++t) {
+			values[t] = (unsigned int) (m->gen_param + first + t);
+		}
+	}
+	else {
+		memset(values, 0, count * sizeof(unsigned int));
+		if (m->generator == MATRIX_GEN_IDENTITY) {
+			/* the diagonal holds every (cols + 1)th position */
+			const unsigned long long step = (unsigned long long) m->cols + 1;
+			const unsigned long long diagonal = m->rows < m->cols ? m->rows : m->cols;
+			for (unsigned long long k = (first + step - 1) / step;
+					k < diagonal && k * step < first + count; ++k) {
+				values[k * step - first] = 1;
+			}
+		}
+	}
+}
+
+/*
+ * PURPOSE: tells whether a matrix has values, stored or generated
+ * INPUTS:
+ *	m the matrix to check
+ * RETURN:
+ *	true if the values can be read
+ **/
+static bool has_values (const Matrix_t* m) {
+	return m->data || m->generator != MATRIX_GEN_NONE;
+}
+
+/*
+ * PURPOSE: gives read access to part of a row of a stored or generated matrix.
+ *	Dense matrices may be read as one long row 0
+ * INPUTS:
+ *	m the matrix to read
+ *	i the row
+ *	col the first col
+ *	count the number of values, at most GENERATE_TILE_ELEMENTS when generated
+ *	scratch where generated values are made
+ * RETURN:
+ *	the values, in the matrix itself or in scratch
+ **/
+static const unsigned int* row_values (const Matrix_t* m, unsigned int i, size_t col,
+			size_t count, unsigned int* scratch) {
+	if (m->data) {
+		return m->data + (size_t) i * m->stride + col;
+	}
+	generate_matrix_values(m, (unsigned long long) i * m->cols + col, count, scratch);
+	return scratch;
+}
+
+/*
+ * PURPOSE: reads one value of a stored or generated matrix
+ * INPUTS:
+ *	m the matrix to read
+ *	i j the row and col of the value
+ * RETURN:
+ *	the value
+ **/
+static unsigned int value_at (const Matrix_t* m, unsigned int i, unsigned int j) {
+	unsigned int value;
+	return *row_values(m, i, j, 1, &value);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Tells whether writing one matrix can change values of another
+*		   that are still to be read, which happens when views of one
+*		   matrix overlap at different places. The same block is safe
+*		   because every value is read before it is written
+* Input: The matrix being written,
+*		 the matrix being read
+* Return: True if results have to go through a scratch copy
+***/
+bool matrices_overlap (const Matrix_t* dst, const Matrix_t* src) {
+	if (!dst || !src || !dst->data || !src->data
+		|| (dst->data == src->data && dst->rows == src->rows && dst->cols == src->cols)
+		|| dst->rows == 0 || dst->cols == 0 || src->rows == 0 || src->cols == 0) {
+		return false;
+	}
+	const Matrix_t* dst_owner = dst->parent ? dst->parent : dst;
+	const Matrix_t* src_owner = src->parent ? src->parent : src;
+	if (dst_owner != src_owner) {
+		return false;
+	}
+	const unsigned int* dst_end = dst->data + (size_t) (dst->rows - 1) * dst->stride + dst->cols;
+	const unsigned int* src_end = src->data + (size_t) (src->rows - 1) * src->stride + src->cols;
+	return dst->data < src_end && src->data < dst_end;
+}
+
+/*
+ * PURPOSE: picks where a result computed from a and b is written: c
+ *	itself, or a scratch matrix of the same size when c overlaps a or b
+ * INPUTS:
+ *	c the result matrix
+ *	a b the operands
+ *	result receives the matrix to write, to be passed to finish_result
+ * RETURN:
+ *	true unless the scratch could not be allocated
+ **/
+static bool begin_result (Matrix_t* c, const Matrix_t* a, const Matrix_t* b, Matrix_t* result) {
+	*result = *c;
+	if (!matrices_overlap(c, a) && !matrices_overlap(c, b)) {
+		return true;
+	}
+	result->data = malloc((size_t) c->rows * c->cols * sizeof(unsigned int));
+	if (!result->data) {
+		printf("Not enough memory for the result of overlapping views\n");
+		return false;
+	}
+	result->stride = c->cols;
+	result->parent = NULL;
+	return true;
+}
+
+/*
+ * PURPOSE: copies a scratch result from begin_result into the result matrix
+ * INPUTS:
+ *	c the result matrix
+ *	result the matrix begin_result gave
+ * RETURN:
+ *	void
+ **/
+static void finish_result (Matrix_t* c, Matrix_t* result) {
+	if (result->data == c->data) {
+		return;
+	}
+	for (unsigned int i = 0; i < c->rows; ++i) {
+		memcpy(c->data + (size_t) i * c->stride, result->data + (size_t) i * result->stride,
+				c->cols * sizeof(unsigned int));
+	}
+	free(result->data);
+}
+
+/*
+ * PURPOSE: runs a row kernel over every row of three same sized matrices.
+ *	Dense matrices are handled as one long row
+ * INPUTS:
+ *	kernel the kernel to run
+ *	a the first operand
+ *	b the second operand (the first again for unary and scalar kernels)
+ *	scalar the scalar operand
+ *	c the result matrix, which may be one of the operands but must not
+ *	overlap them elsewhere (see begin_result)
+ * RETURN:
+ *	void
+ **/
+static void apply_row_kernel (Row_Kernel_t kernel, const Matrix_t* a, const Matrix_t* b,
+			unsigned int scalar, Matrix_t* c) {
+	const bool dense = is_dense(a) && is_dense(b) && is_dense(c);
+	if (a->data && b->data) {
+		if (dense) {
+			kernel(a->data, b->data, scalar, c->data, (size_t) a->rows * a->cols);
+			return;
+		}
+		for (unsigned int i = 0; i < a->rows; ++i) {
+			kernel(a->data + (size_t) i * a->stride, b->data + (size_t) i * b->stride, scalar,
+					c->data + (size_t) i * c->stride, a->cols);
+		}
+		return;
+	}
+
+	/* generated operands are made a tile at a time right before the kernel uses them */
+	unsigned int a_tile[GENERATE_TILE_ELEMENTS];
+	unsigned int b_tile[GENERATE_TILE_ELEMENTS];
+	const unsigned int rows = dense ? 1 : a->rows;
+	const size_t cols = dense ? (size_t) a->rows * a->cols : a->cols;
+	for (unsigned int i = 0; i < rows; ++i) {
+		for (size_t col = 0; col < cols; col += GENERATE_TILE_ELEMENTS) {
+			const size_t n = cols - col < GENERATE_TILE_ELEMENTS ? cols - col : GENERATE_TILE_ELEMENTS;
+			const unsigned int* a_values = row_values(a, i, col, n, a_tile);
+			const unsigned int* b_values = b == a ? a_values : row_values(b, i, col, n, b_tile);
+			kernel(a_values, b_values, scalar, c->data + (size_t) i * c->stride + col, n);
+		}
+	}
+}
+
+/*
+ * PURPOSE: gives back the memory behind the data of a matrix, whether it
+ *	was allocated or mapped from a workspace
+ * INPUTS:
+ *	m the matrix, which must not be a view
+ * RETURN:
+ *	void
+ **/
+static void release_data (Matrix_t* m) {
+	if (m->mapping) {
+		munmap(m->mapping, m->mapping_bytes);
+		m->mapping = NULL;
+		m->mapping_bytes = 0;
+	}
+	else if (!has_inline_data(m)) {
+		free(m->data);
+	}
+	m->data = NULL;
+}
+
+/*
+ * PURPOSE: takes a matrix about to be freed off the held commands that used it
+ * INPUTS:
+ *	m the matrix
+ * RETURN:
+ *	void
+ **/
+static void unpin_matrix (Matrix_t* m) {
+	pthread_mutex_lock(&registry_lock);
+	for (Matrix_Pin_t* p = m->pin_count > 0 ? pins : NULL; p; p = p->next) {
+		for (unsigned int i = 0; i < p->num_used; ) {
+			if (p->used[i] == m) {
+				p->used[i] = p->used[--p->num_used];
+			}
+			else {
+				++i;
+			}
+		}
+	}
+	m->pin_count = 0;
+	pthread_mutex_unlock(&registry_lock);
+}
+
+/*
+ * PURPOSE: frees a matrix header and the data it owns
+ * INPUTS:
+ *	m the matrix, which must not be a view
+ * RETURN:
+ *	void
+ **/
+static void free_matrix (Matrix_t* m) {
+	unpin_matrix(m);
+	release_data(m);
+	if (m->spill_path) {
+		unlink(m->spill_path);
+		free(m->spill_path);
+	}
+	free(m->sat);
+	free(m);
+}
+
+typedef void (*Parallel_Task_t) (void* context, unsigned int begin, unsigned int end);
+
+typedef struct {
+	Parallel_Task_t task;
+	void* context;
+	unsigned int begin;
+	unsigned int end;
+} Parallel_Range_t;
+
+/*
+ * PURPOSE: thread entry that runs a task over its share of the range
+ * INPUTS:
+ *	arg the Parallel_Range_t of this thread
+ * RETURN:
+ *	NULL
+ **/
+static void* parallel_worker (void* arg) {
+	TRACE_SCOPE("parallel_worker", "compute");
+	Parallel_Range_t* range = arg;
+	range->task(range->context, range->begin, range->end);
+	return NULL;
+}
+
+/*
+ * PURPOSE: splits [0, count) into one contiguous range per online CPU and
+ *	runs the task on each range in its own thread. Small jobs and failures
+ *	to start a thread fall back to the calling thread.
+ * INPUTS:
+ *	task the work to do for a range
+ *	context passed through to the task
+ *	count the number of work items
+ *	elements the total amount of data touched, to decide if threads pay off
+ * RETURN:
+ *	void
+ **/
+static void run_parallel (Parallel_Task_t task, void* context, unsigned int count, size_t elements) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int threads = cpus > 1 ? (unsigned int) cpus : 1;
+	if (threads > MAX_THREADS) {
+		threads = MAX_THREADS;
+	}
+	if (threads > count) {
+		threads = count;
+	}
+	if (threads <= 1 || elements < PARALLEL_MIN_ELEMENTS) {
+		task(context, 0, count);
+		return;
+	}
+
+	pthread_t ids[MAX_THREADS];
+	Parallel_Range_t ranges[MAX_THREADS];
+	bool started[MAX_THREADS];
+	for (unsigned int t = 0; t < threads; ++t) {
+		ranges[t].task = task;
+		ranges[t].context = context;
+		ranges[t].begin = (unsigned long long) count * t / threads;
+		ranges[t].end = (unsigned long long) count * (t + 1) / threads;
+		started[t] = t > 0 && pthread_create(&ids[t], NULL, parallel_worker, &ranges[t]) == 0;
+	}
+	for (unsigned int t = 0; t < threads; ++t) {
+		if (!started[t]) {
+			task(context, ranges[t].begin, ranges[t].end);
+		}
+	}
+	for (unsigned int t = 1; t < threads; ++t) {
+		if (started[t]) {
+			pthread_join(ids[t], NULL);
+		}
+	}
+}
+
+/*
+ * PURPOSE: writes a whole buffer at a file offset, retrying short writes
+ * INPUTS:
+ *	fd the open file to write to
+ *	buffer the bytes to write
+ *	bytes how many bytes to write
+ *	offset where in the file the bytes go
+ * RETURN:
+ *	true if every byte was written
+ **/
+static bool write_fully (int fd, const void* buffer, size_t bytes, off_t offset) {
+	const unsigned char* p = buffer;
+	while (bytes > 0) {
+		ssize_t written = pwrite(fd, p, bytes, offset);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			return false;
+		}
+		p += written;
+		bytes -= written;
+		offset += written;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: reads a whole buffer from a file offset, retrying short reads
+ * INPUTS:
+ *	fd the open file to read from
+ *	buffer where the bytes go
+ *	bytes how many bytes to read
+ *	offset where in the file the bytes are
+ * RETURN:
+ *	true if every byte was read
+ **/
+static bool read_fully (int fd, void* buffer, size_t bytes, off_t offset) {
+	unsigned char* p = buffer;
+	while (bytes > 0) {
+		ssize_t got = pread(fd, p, bytes, offset);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			return false;
+		}
+		p += got;
+		bytes -= got;
+		offset += got;
+	}
+	return true;
+}
+
+/*
+ * CRC32C (Castagnoli) of matrix files. CPUs with SSE4.2 have an
+ * instruction for it; everywhere else a byte table does the work.
+ */
+typedef unsigned int (*Crc32c_Update_t) (unsigned int crc, const unsigned char* p, size_t bytes);
+
+static unsigned int crc32c_table[256];
+static Crc32c_Update_t crc32c_update = NULL;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+/*
+ * PURPOSE: advances a raw CRC32C one byte at a time through the table
+ * INPUTS:
+ *	crc the raw checksum so far
+ *	p the bytes to add
+ *	bytes how many bytes to add
+ * RETURN:
+ *	the new raw checksum
+ **/
+static unsigned int crc32c_software (unsigned int crc, const unsigned char* p, size_t bytes) {
+	while (bytes-- > 0) {
+		crc = crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+#ifdef CRC32C_HARDWARE
+/*
+ * PURPOSE: advances a raw CRC32C eight bytes at a time with the SSE4.2
+ *	crc32 instruction
+ * INPUTS:
+ *	crc the raw checksum so far
+ *	p the bytes to add
+ *	bytes how many bytes to add
+ * RETURN:
+ *	the new raw checksum
+ **/
+__attribute__((target("sse4.2")))
+static unsigned int crc32c_sse42 (unsigned int crc, const unsigned char* p, size_t bytes) {
+	unsigned long long wide = crc;
+	for (; bytes >= sizeof(unsigned long long); bytes -= sizeof(unsigned long long)) {
+		unsigned long long word;
+		memcpy(&word, p, sizeof(word));
+		wide = _mm_crc32_u64(wide, word);
+		p += sizeof(word);
+	}
+	crc = (unsigned int) wide;
+	while (bytes-- > 0) {
+		crc = _mm_crc32_u8(crc, *p++);
+	}
+	return crc;
+}
+#endif
+
+/*
+ * PURPOSE: builds the table and picks the fastest CRC32C routine
+ * INPUTS:
+ *	none
+ * RETURN:
+ *	void
+ **/
+static void init_crc32c (void) {
+	for (unsigned int i = 0; i < 256; ++i) {
+		unsigned int crc = i;
+		for (unsigned int bit = 0; bit < 8; ++bit) {
+			crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78 : 0);
+		}
+		crc32c_table[i] = crc;
+	}
+	crc32c_update = crc32c_software;
+#ifdef CRC32C_HARDWARE
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		crc32c_update = crc32c_sse42;
+	}
+#endif
+}
+
+/*
+ * PURPOSE: extends a CRC32C with more bytes; crc32c(crc32c(0, a), b) is
+ *	the checksum of a followed by b
+ * INPUTS:
+ *	crc the checksum of the bytes before, 0 to start
+ *	data the bytes to add
+ *	bytes how many bytes to add
+ * RETURN:
+ *	the checksum including data
+ **/
+static unsigned int crc32c (unsigned int crc, const void* data, size_t bytes) {
+	pthread_once(&crc32c_once, init_crc32c);
+	return ~crc32c_update(~crc, data, bytes);
+}
+
+/*
+ * Matrix files hold the name length, the name, the rows, the cols and the
+ * values, then the CRC32C of all of those and an EOF byte. The top bit of
+ * the name length marks a file that carries the checksum, so one that lost
+ * its checksum reads as damaged rather than as an older file. Files written
+ * before the checksum existed end right after the values with the EOF byte.
+ */
+#define MATRIX_FILE_CHECKSUMMED 0x80000000u
+
+typedef struct {
+	int fd;
+	char name[MATRIX_NAME_LEN];
+	unsigned int rows;
+	unsigned int cols;
+	off_t data_offset;
+	bool has_checksum;
+	unsigned int stored_crc;
+	unsigned int crc;	/* checksum of the bytes read so far */
+} Matrix_File_t;
+
+/*
+ * PURPOSE: lays out the header of a matrix file
+ * INPUTS:
+ *	header receives at least 3 * sizeof(unsigned int) + MATRIX_NAME_LEN bytes
+ *	name the matrix name
+ *	rows the number of rows
+ *	cols the number of cols
+ * RETURN:
+ *	the length of the header, which is where the values start
+ **/
+static size_t pack_matrix_header (unsigned char* header, const char* name,
+			unsigned int rows, unsigned int cols) {
+	const unsigned int name_len = strnlen(name, MATRIX_NAME_LEN - 1) + 1;
+	const unsigned int name_word = name_len | MATRIX_FILE_CHECKSUMMED;
+	memcpy(header, &name_word, sizeof(unsigned int));
+	memcpy(header + sizeof(unsigned int), name, name_len - 1);
+	header[sizeof(unsigned int) + name_len - 1] = '\0';
+	memcpy(header + sizeof(unsigned int) + name_len, &rows, sizeof(unsigned int));
+	memcpy(header + 2 * sizeof(unsigned int) + name_len, &cols, sizeof(unsigned int));
+	return 3 * sizeof(unsigned int) + name_len;
+}
+
+/*
+ * PURPOSE: writes the checksum and the EOF byte that close a matrix file
+ * INPUTS:
+ *	fd the matrix file
+ *	offset where the values end
+ *	crc the checksum of the header and the values
+ * RETURN:
+ *	true if both were written
+ **/
+static bool write_matrix_trailer (int fd, off_t offset, unsigned int crc) {
+	unsigned char trailer[sizeof(unsigned int) + 1];
+	memcpy(trailer, &crc, sizeof(unsigned int));
+	trailer[sizeof(unsigned int)] = (unsigned char) EOF;
+	return write_fully(fd, trailer, sizeof(trailer), offset);
+}
+
+/*
+ * PURPOSE: opens a matrix file and reads its header and stored checksum
+ *	without touching the values
+ * INPUTS:
+ *	filename the matrix file
+ *	file receives the descriptor, the header and the checksum state
+ * RETURN:
+ *	true if the file has the size its header promises
+ **/
+static bool open_matrix_file (const char* filename, Matrix_File_t* file) {
+	file->fd = open(filename, O_RDONLY);
+	if (file->fd < 0) {
+		return false;
+	}
+	unsigned char header[3 * sizeof(unsigned int) + MATRIX_NAME_LEN];
+	unsigned int name_word = 0;
+	struct stat st;
+	if (!read_fully(file->fd, &name_word, sizeof(unsigned int), 0)) {
+		close(file->fd);
+		return false;
+	}
+	const bool flagged = (name_word & MATRIX_FILE_CHECKSUMMED) != 0;
+	const unsigned int name_len = name_word & ~MATRIX_FILE_CHECKSUMMED;
+	if (name_len == 0 || name_len > MATRIX_NAME_LEN
+		|| !read_fully(file->fd, header, 3 * sizeof(unsigned int) + name_len, 0)
+		|| fstat(file->fd, &st)) {
+		close(file->fd);
+		return false;
+	}
+	memcpy(file->name, header + sizeof(unsigned int), name_len);
+	file->name[name_len - 1] = '\0';
+	memcpy(&file->rows, header + sizeof(unsigned int) + name_len, sizeof(unsigned int));
+	memcpy(&file->cols, header + 2 * sizeof(unsigned int) + name_len, sizeof(unsigned int));
+	file->data_offset = 3 * sizeof(unsigned int) + name_len;
+	file->crc = crc32c(0, header, file->data_offset);
+
+	const unsigned long long data_end = file->data_offset
+			+ (unsigned long long) file->rows * file->cols * sizeof(unsigned int);
+	file->has_checksum = flagged;
+	const unsigned long long file_end = data_end + (flagged ? sizeof(unsigned int) : 0) + 1;
+	if ((unsigned long long) st.st_size != file_end
+		|| (flagged && !read_fully(file->fd, &file->stored_crc, sizeof(unsigned int), data_end))) {
+		close(file->fd);
+		return false;
+	}
+	posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return true;
+}
+
+/*
+ * PURPOSE: reads values of a matrix file and adds them to its running
+ *	checksum, a chunk at a time so the bytes are still in cache
+ * INPUTS:
+ *	file the open matrix file
+ *	buffer where the values go
+ *	count how many values to read
+ *	first the index of the first value to read
+ * RETURN:
+ *	true if every value was read
+ **/
+static bool read_matrix_values (Matrix_File_t* file, unsigned int* buffer, size_t count, size_t first) {
+	while (count > 0) {
+		const size_t n = count < STREAM_CHUNK_ELEMENTS ? count : STREAM_CHUNK_ELEMENTS;
+		if (!read_fully(file->fd, buffer, n * sizeof(unsigned int),
+				file->data_offset + first * sizeof(unsigned int))) {
+			return false;
+		}
+		file->crc = crc32c(file->crc, buffer, n * sizeof(unsigned int));
+		buffer += n;
+		first += n;
+		count -= n;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: tells if the values read match the stored checksum; files
+ *	without a checksum always match
+ * INPUTS:
+ *	file a matrix file whose values have all been read in order
+ * RETURN:
+ *	true if the checksum matches
+ **/
+static bool matrix_file_intact (const Matrix_File_t* file) {
+	return !file->has_checksum || file->crc == file->stored_crc;
+}
+
+/* 
+ * PURPOSE: instantiates a new matrix with the passed name, rows, cols 
+ * INPUTS: 
+ *	name the name of the matrix limited to 50 characters 
+ *  rows the number of rows the matrix
+ *  cols the number of cols the matrix
+ * RETURN:
+ *  If no errors occurred during instantiation then true
+ *  else false for an error in the process.
+ *
+ **/
+
+bool create_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+						const unsigned int cols) {
+	TRACE_SCOPE("create_matrix", "allocate");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if((*new_matrix) != NULL){
+		printf("Matrix already exists\n");
+		return false;
+	}
+	if(name == NULL || strcmp(name, "\n") == 0){
+		printf("There's no name for the matrix!\n");
+		return false;
+	}
+	if(rows < 0 || rows > 4294967295){
+		printf("Number of rows outside of valid range\n");
+		return false;	
+	}
+	if(cols < 0 || cols > 4294967295){
+		printf("Number of cols outside of valid range\n");
+		return false;
+	}
+	unsigned int len = strlen(name) + 1; 
+	if (len > MATRIX_NAME_LEN) {
+		printf("Matrix name %s is longer than %d characters\n", name, MATRIX_NAME_LEN - 1);
+		return false;
+	}
+	
+	/* small matrices live in the same allocation as their header */
+	const size_t elements = (size_t) rows * cols;
+	if (elements <= MATRIX_INLINE_ELEMENTS) {
+		*new_matrix = calloc(1,sizeof(Matrix_t) + elements * sizeof(unsigned int));
+		if (!(*new_matrix)) {
+			return false;
+		}
+		(*new_matrix)->data = (unsigned int*) ((*new_matrix) + 1);
+	}
+	else {
+		*new_matrix = calloc(1,sizeof(Matrix_t));
+		if (!(*new_matrix)) {
+			return false;
+		}
+		(*new_matrix)->data = calloc(elements,sizeof(unsigned int));
+		if (!(*new_matrix)->data) {
+			free(*new_matrix);
+			*new_matrix = NULL;
+			return false;
+		}
+	}
+	(*new_matrix)->rows = rows;
+	(*new_matrix)->cols = cols;
+	(*new_matrix)->stride = cols;
+	strncpy((*new_matrix)->name,name,len);
+	return true;
+
+}
+
+/* 
+ * PURPOSE: instantiates a view that shares the data of part of another
+ *	matrix. Changes through the view change the parent and the other way
+ *	around. The parent data stays alive until its last view is destroyed.
+ * INPUTS: 
+ *	view where the new view is returned, must point to NULL
+ *	name the name of the view
+ *	parent the matrix (or view) to look into
+ *	row_start row_end the rows [row_start, row_end) of the parent
+ *	col_start col_end the cols [col_start, col_end) of the parent
+ * RETURN:
+ *  If the ranges fit inside the parent then true
+ *  else false for an error in the process.
+ *
+ **/
+bool create_view (Matrix_t** view, const char* name, Matrix_t* parent, unsigned int row_start,
+			unsigned int row_end, unsigned int col_start, unsigned int col_end) {
+	TRACE_SCOPE("create_view", "allocate");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!view || (*view) != NULL) {
+		printf("Matrix already exists\n");
+		return false;
+	}
+	if (!parent || !has_values(parent)) {
+		printf("Parent matrix does not exist\n");
+		return false;
+	}
+	if (name == NULL || strlen(name) + 1 > MATRIX_NAME_LEN) {
+		printf("Invalid name for the view\n");
+		return false;
+	}
+	if (row_start > row_end || row_end > parent->rows
+		|| col_start > col_end || col_end > parent->cols) {
+		printf("View range outside of (%u,%u)\n", parent->rows, parent->cols);
+		return false;
+	}
+
+	if (!materialize_matrix(parent)) {
+		return false;
+	}
+
+	*view = calloc(1,sizeof(Matrix_t));
+	if (!(*view)) {
+		return false;
+	}
+	Matrix_t* owner = parent->parent ? parent->parent : parent;
+	(*view)->data = parent->data + (size_t) row_start * parent->stride + col_start;
+	(*view)->rows = row_end - row_start;
+	(*view)->cols = col_end - col_start;
+	(*view)->stride = parent->stride;
+	(*view)->parent = owner;
+	owner->views++;
+	strncpy((*view)->name,name,MATRIX_NAME_LEN - 1);
+	return true;
+}
+
+/* 
+ * PURPOSE: instantiates a matrix whose values come from a rule instead of
+ *	memory. Reads make the values they need; the first write stores them
+ * INPUTS: 
+ *	new_matrix where the new matrix is returned, must point to NULL
+ *	name the name of the matrix
+ *	rows cols the size of the matrix
+ *	generator the rule: random values from a seed, the identity matrix,
+ *		one constant, or consecutive values row after row
+ *	param the seed, the constant or the first value, unused by identity
+ * RETURN:
+ *  If the matrix header was allocated then true
+ *  else false for an error in the process.
+ *
+ **/
+bool generate_matrix (Matrix_t** new_matrix, const char* name, unsigned int rows, unsigned int cols,
+			Matrix_Gen_t generator, unsigned long long param) {
+	TRACE_SCOPE("generate_matrix", "allocate");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!new_matrix || (*new_matrix) != NULL) {
+		printf("Matrix already exists\n");
+		return false;
+	}
+	if (name == NULL || strlen(name) + 1 > MATRIX_NAME_LEN) {
+		printf("Invalid name for the matrix\n");
+		return false;
+	}
+	if (generator == MATRIX_GEN_NONE || generator > MATRIX_GEN_RANGE) {
+		printf("Unknown generator\n");
+		return false;
+	}
+	if (rows == 0 || cols == 0) {
+		printf("Generated matrices need at least one row and one col\n");
+		return false;
+	}
+
+	*new_matrix = calloc(1,sizeof(Matrix_t));
+	if (!(*new_matrix)) {
+		return false;
+	}
+	(*new_matrix)->rows = rows;
+	(*new_matrix)->cols = cols;
+	(*new_matrix)->stride = cols;
+	(*new_matrix)->generator = generator;
+	(*new_matrix)->gen_param = param;
+	strncpy((*new_matrix)->name,name,MATRIX_NAME_LEN - 1);
+	return true;
+}
+
+/*
+ * PURPOSE: stores the values of a band of rows of a matrix being materialized
+ * INPUTS:
+ *	context the matrix, with data allocated and the generator still set
+ *	begin end the rows to fill
+ * RETURN:
+ *	void
+ **/
+static void materialize_rows (void* context, unsigned int begin, unsigned int end) {
+	Matrix_t* m = context;
+	generate_matrix_values(m, (unsigned long long) begin * m->cols, (size_t) (end - begin) * m->cols,
+			m->data + (size_t) begin * m->cols);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Stores the values of a generated matrix so it can be written to.
+*		   Matrices that already store their values are left alone
+* Input: The matrix
+* Return: True/False
+***/
+bool materialize_matrix (Matrix_t* m) {
+	TRACE_SCOPE("materialize_matrix", "allocate");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m) {
+		printf("No matrix found\n");
+		return false;
+	}
+	if (m->data || m->generator == MATRIX_GEN_NONE) {
+		return true;
+	}
+
+	const size_t elements = (size_t) m->rows * m->cols;
+	m->data = malloc(elements ? elements * sizeof(unsigned int) : 1);
+	if (!m->data) {
+		printf("Failed to allocate the matrix data\n");
+		return false;
+	}
+	run_parallel(materialize_rows, m, m->rows, elements);
+	m->generator = MATRIX_GEN_NONE;
+	touch_matrix(m);
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Destroys the matrix and frees the memory at that location.
+*		   Data that views still reference is freed with the last view
+* Input: A matrix
+* Return: void
+***/
+void destroy_matrix (Matrix_t** m) {
+	TRACE_SCOPE("destroy_matrix", "allocate");
+
+	// ERROR CHECK INCOMING PARAMETERS
+		if(*m == NULL){
+		printf("matrix does not exist\n");
+		return;
+	}
+	
+	Matrix_t* owner = (*m)->parent;
+	if (owner) {
+		/* a view only frees its header, and the parent once unreferenced */
+		unpin_matrix(*m);
+		free((*m)->sat);
+		free(*m);
+		owner->views--;
+		if (owner->views == 0 && owner->detached) {
+			free_matrix(owner);
+		}
+	}
+	else if ((*m)->views > 0) {
+		(*m)->detached = true;
+	}
+	else {
+		free_matrix(*m);
+	}
+	*m = NULL;
+}
+
+
+	
+	// FUNCTION COMMENT
+/***
+* Purpose: Check if the two given matrices are equal
+* Input: 2 seperate matrices 
+* Return: True/False
+***/
+bool equal_matrices (Matrix_t* a, Matrix_t* b) {
+	TRACE_SCOPE("equal_matrices", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if(a == NULL){
+		printf("First matrix is null\n");
+		return false;
+	}
+	if(!has_values(a)){
+		printf("First matrix does not have any data\n");
+		return false;
+	}
+	if(b == NULL){
+		printf("Second matrix is null\n");
+		return false;
+	}
+	if(!has_values(b)){
+		printf("Second matrix does not have any data\n");
+		return false;
+	}
+	if (a->rows != b->rows || a->cols != b->cols) {
+		return false;
+	}
+	if (a == b) {
+		return true;
+	}
+
+	if (!a->data || !b->data) {
+		unsigned int a_tile[GENERATE_TILE_ELEMENTS];
+		unsigned int b_tile[GENERATE_TILE_ELEMENTS];
+		for (unsigned int i = 0; i < a->rows; ++i) {
+			for (size_t col = 0; col < a->cols; col += GENERATE_TILE_ELEMENTS) {
+				const size_t n = a->cols - col < GENERATE_TILE_ELEMENTS ? a->cols - col : GENERATE_TILE_ELEMENTS;
+				if (memcmp(row_values(a, i, col, n, a_tile), row_values(b, i, col, n, b_tile),
+						sizeof(unsigned int) * n) != 0) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	if (is_dense(a) && is_dense(b)) {
+		const Small_Kernels_t* kernels = find_small_kernels(a->rows, a->cols);
+		if (kernels) {
+			return kernels->equal(a->data, b->data);
+		}
+
+		int result = memcmp(a->data,b->data, sizeof(unsigned int) * a->rows * a->cols);
+		if (result == 0) {
+			return true;
+		}
+		return false;
+	}
+
+	for (unsigned int i = 0; i < a->rows; ++i) {
+		if (memcmp(a->data + (size_t) i * a->stride, b->data + (size_t) i * b->stride,
+				sizeof(unsigned int) * a->cols) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Copy a matrix into a different empty matrix
+* Input: The source matrix and an empty matrix
+* Return: True/False
+***/
+bool duplicate_matrix (Matrix_t* src, Matrix_t* dest) {
+	TRACE_SCOPE("duplicate_matrix", "compute");
+
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!src){
+		printf("Source matrix does not exist\n");
+		return false;
+	}
+	if (!dest){
+		printf("Destination matrix does not exist\n");
+		return false;
+	}
+	if (!has_values(src)){
+		printf("The source matrix does not have any data\n");
+		return false;
+	}
+	if (!has_values(dest)){
+		printf("Destination matrix does not have a place for the data\n");
+		return false;
+	}
+	if (src == dest) {
+		return true;
+	}
+	if (src->rows != dest->rows || src->cols != dest->cols) {
+		printf("Source and destination matrices have different dimensions\n");
+		return false;
+	}
+	if (!src->data && !dest->data) {
+		/* a copy of a generated matrix is the same rule */
+		dest->generator = src->generator;
+		dest->gen_param = src->gen_param;
+		touch_matrix(dest);
+		return true;
+	}
+	if (!materialize_matrix(dest)) {
+		return false;
+	}
+	if (!src->data) {
+		for (unsigned int i = 0; i < src->rows; ++i) {
+			generate_matrix_values(src, (unsigned long long) i * src->cols, src->cols,
+					dest->data + (size_t) i * dest->stride);
+		}
+		touch_matrix(dest);
+		return true;
+	}
+	if (!src->parent && !dest->parent) {
+		const Small_Kernels_t* kernels = find_small_kernels(src->rows, src->cols);
+		if (kernels) {
+			kernels->copy(src->data, dest->data);
+			touch_matrix(dest);
+			return true;
+		}
+		/*
+		 * copy over data
+		 */
+		unsigned int bytesToCopy = sizeof(unsigned int) * src->rows * src->cols;
+		memcpy(dest->data,src->data, bytesToCopy);	
+		touch_matrix(dest);
+		return equal_matrices (src,dest);
+	}
+
+	/* views may overlap their source, rows are copied away from the overlap */
+	const bool backwards = dest->data > src->data;
+	for (unsigned int n = 0; n < src->rows; ++n) {
+		const unsigned int i = backwards ? src->rows - 1 - n : n;
+		memmove(dest->data + (size_t) i * dest->stride, src->data + (size_t) i * src->stride,
+				sizeof(unsigned int) * src->cols);
+	}
+	touch_matrix(dest);
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Shift a matrix either to the left or right by a set number of positions
+* Input: The matrix to shift,
+*		 a direction to shift,
+*		 how many positions to shift the matrix
+* Return: True/False
+***/
+bool bitwise_shift_matrix (Matrix_t* a, char direction, unsigned int shift) {
+	return bitwise_shift_matrix_into(a, direction, shift, a);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Shift every value of a matrix to the left or right and store
+*		   the result in a matrix of the same size, which may be the
+*		   source matrix itself
+* Input: The matrix to shift,
+*		 a direction to shift,
+*		 how many positions to shift the matrix,
+*		 the matrix that receives the shifted values
+* Return: True/False
+***/
+bool bitwise_shift_matrix_into (Matrix_t* a, char direction, unsigned int shift, Matrix_t* dest) {
+	TRACE_SCOPE("bitwise_shift_matrix", "compute");
+	
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!a || !dest) {
+		printf("No matrix found\n");
+		return false;
+	}
+	if(!has_values(a) || !has_values(dest)){
+		printf("No data found in matrix\n");
+		return false;
+	}
+	if(direction != 'l' && direction != 'r'){
+		printf("Invalid shift direction!\n");
+		return false;
+	}
+	if(shift >= sizeof(unsigned int) * 8){
+		printf("Invalid range for shift\n");
+		return false;
+	}	
+	if (a->rows != dest->rows || a->cols != dest->cols) {
+		printf("Destination matrix has different dimensions\n");
+		return false;
+	}
+
+	/*the scalar kernels vectorize the shift and handle overlapping views*/
+	return scalar_matrix(direction == 'l' ? MATRIX_OP_SHL_SCALAR : MATRIX_OP_SHR_SCALAR, a, shift, dest);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Adds up every value in a matrix
+* Input: The matrix to sum
+* Return: The sum, wrapping around like the unsigned values it adds
+***/
+int sum_matrix (Matrix_t* m) {
+	TRACE_SCOPE("sum_matrix", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m) {
+		printf("No matrix found\n");
+		return 0;
+	}
+	if (!has_values(m)) {
+		printf("No data found in matrix\n");
+		return 0;
+	}
+
+	unsigned int tile[GENERATE_TILE_ELEMENTS];
+	unsigned int sum = 0;
+	for (unsigned int i = 0; i < m->rows; ++i) {
+		for (size_t col = 0; col < m->cols; col += GENERATE_TILE_ELEMENTS) {
+			const size_t n = m->cols - col < GENERATE_TILE_ELEMENTS ? m->cols - col : GENERATE_TILE_ELEMENTS;
+			const unsigned int* row = row_values(m, i, col, n, tile);
+			for (size_t j = 0; j < n; ++j) {
+				sum += row[j];
+			}
+		}
+	}
+	return sum;
+}
+
+typedef struct {
+	const Matrix_t* m;
+	unsigned long long* sat;
+} Sat_Build_t;
+
+/*
+ * PURPOSE: first summed-area pass, prefix sums along each row in a range
+ * INPUTS:
+ *	context the Sat_Build_t being built
+ *	begin end the rows to scan
+ * RETURN:
+ *	void
+ **/
+static void sat_scan_rows (void* context, unsigned int begin, unsigned int end) {
+	const Sat_Build_t* build = context;
+	const Matrix_t* m = build->m;
+	const size_t width = (size_t) m->cols + 1;
+	unsigned int tile[GENERATE_TILE_ELEMENTS];
+	for (unsigned int i = begin; i < end; ++i) {
+		unsigned long long* out = build->sat + (i + 1) * width;
+		unsigned long long running = 0;
+		out[0] = 0;
+		for (size_t col = 0; col < m->cols; col += GENERATE_TILE_ELEMENTS) {
+			const size_t n = m->cols - col < GENERATE_TILE_ELEMENTS ? m->cols - col : GENERATE_TILE_ELEMENTS;
+			const unsigned int* row = row_values(m, i, col, n, tile);
+			for (size_t j = 0; j < n; ++j) {
+				running += row[j];
+				out[col + j + 1] = running;
+			}
+		}
+	}
+}
+
+/*
+ * PURPOSE: second summed-area pass, accumulates rows downwards for a band
+ *	of columns. Walking row by row over the band keeps the access sequential
+ * INPUTS:
+ *	context the Sat_Build_t being built
+ *	begin end the columns of the table to accumulate
+ * RETURN:
+ *	void
+ **/
+static void sat_scan_cols (void* context, unsigned int begin, unsigned int end) {
+	const Sat_Build_t* build = context;
+	const size_t width = (size_t) build->m->cols + 1;
+	for (size_t i = 2; i <= build->m->rows; ++i) {
+		unsigned long long* row = build->sat + i * width;
+		const unsigned long long* above = row - width;
+		for (unsigned int j = begin; j < end; ++j) {
+			row[j] += above[j];
+		}
+	}
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Marks the data of a matrix (and of the matrix it views) as
+*		   changed, so cached results built from it are rebuilt
+* Input: The matrix that was written to
+* Return: void
+***/
+void touch_matrix (Matrix_t* m) {
+	if (!m) {
+		return;
+	}
+	Matrix_t* owner = m->parent ? m->parent : m;
+	owner->version++;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Sums the values in the rows [row_start, row_end) and cols
+*		   [col_start, col_end) of a matrix in constant time. A 64 bit
+*		   summed-area table is built with a two pass parallel scan on
+*		   first use and kept until the data changes
+* Input: The matrix,
+*		 the row range,
+*		 the col range,
+*		 where the sum is returned
+* Return: True/False
+***/
+bool region_sum_matrix (Matrix_t* m, unsigned int row_start, unsigned int row_end,
+			unsigned int col_start, unsigned int col_end, unsigned long long* sum) {
+	TRACE_SCOPE("region_sum_matrix", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m || !sum) {
+		printf("No matrix found\n");
+		return false;
+	}
+	if (!has_values(m)) {
+		printf("No data found in matrix\n");
+		return false;
+	}
+	if (row_start > row_end || row_end > m->rows || col_start > col_end || col_end > m->cols) {
+		printf("Region outside of (%u,%u)\n", m->rows, m->cols);
+		return false;
+	}
+
+	const Matrix_t* owner = m->parent ? m->parent : m;
+	const size_t width = (size_t) m->cols + 1;
+	if (!m->sat || m->sat_version != owner->version) {
+		if (!m->sat) {
+			m->sat = calloc(((size_t) m->rows + 1) * width, sizeof(unsigned long long));
+			if (!m->sat) {
+				printf("Failed to allocate the summed-area table\n");
+				return false;
+			}
+		}
+		Sat_Build_t build = { m, m->sat };
+		const size_t elements = (size_t) m->rows * m->cols;
+		run_parallel(sat_scan_rows, &build, m->rows, elements);
+		run_parallel(sat_scan_cols, &build, m->cols + 1, elements);
+		m->sat_version = owner->version;
+	}
+
+	const unsigned long long* sat = m->sat;
+	*sum = sat[row_end * width + col_end] - sat[row_start * width + col_end]
+		- sat[row_end * width + col_start] + sat[row_start * width + col_start];
+	return true;
+}
+
+/* width of the running values a row is folded into before the last step */
+#define REDUCE_LANES 64
+
+typedef struct {
+	const Matrix_t* m;
+	Row_Kernel_t kernel;
+	Matrix_t* out;
+	bool merged;	/* out holds the partial result of some rows */
+	bool failed;
+	pthread_mutex_t lock;
+} Reduce_Job_t;
+
+/*
+ * PURPOSE: reduces each row of a range of rows to one value. The row is
+ *	folded into REDUCE_LANES running values with the row kernel and those
+ *	are folded into one at the end, so the work stays vectorized
+ * INPUTS:
+ *	context the Reduce_Job_t
+ *	begin the first row
+ *	end one past the last row
+ * RETURN:
+ *	void
+ **/
+static void reduce_rows_task (void* context, unsigned int begin, unsigned int end) {
+	Reduce_Job_t* job = context;
+	const size_t cols = job->m->cols;
+	unsigned int tile[GENERATE_TILE_ELEMENTS];
+	unsigned int acc[REDUCE_LANES];
+	for (unsigned int i = begin; i < end; ++i) {
+		size_t width = 0;
+		for (size_t col = 0; col < cols; col += GENERATE_TILE_ELEMENTS) {
+			const size_t n = cols - col < GENERATE_TILE_ELEMENTS ? cols - col : GENERATE_TILE_ELEMENTS;
+			const unsigned int* row = row_values(job->m, i, col, n, tile);
+			size_t j = 0;
+			if (width == 0) {
+				width = n < REDUCE_LANES ? n : REDUCE_LANES;
+				memcpy(acc, row, width * sizeof(unsigned int));
+				j = width;
+			}
+			for (; j + width <= n; j += width) {
+				job->kernel(acc, row + j, 0, acc, width);
+			}
+			if (j < n) {
+				job->kernel(acc, row + j, 0, acc, n - j);
+			}
+		}
+		for (size_t j = 1; j < width; ++j) {
+			job->kernel(acc, acc + j, 0, acc, 1);
+		}
+		job->out->data[(size_t) i * job->out->stride] = acc[0];
+	}
+}
+
+/*
+ * PURPOSE: reduces each column over a range of rows. Whole rows are
+ *	streamed into one running row with the row kernel instead of walking
+ *	down the columns, and the running row is merged into the result
+ * INPUTS:
+ *	context the Reduce_Job_t
+ *	begin the first row
+ *	end one past the last row
+ * RETURN:
+ *	void
+ **/
+static void reduce_cols_task (void* context, unsigned int begin, unsigned int end) {
+	Reduce_Job_t* job = context;
+	const size_t cols = job->m->cols;
+	unsigned int* acc = malloc(cols * sizeof(unsigned int));
+	if (!acc) {
+		printf("Not enough memory to reduce the columns\n");
+		pthread_mutex_lock(&job->lock);
+		job->failed = true;
+		pthread_mutex_unlock(&job->lock);
+		return;
+	}
+	unsigned int tile[GENERATE_TILE_ELEMENTS];
+	for (unsigned int i = begin; i < end; ++i) {
+		for (size_t col = 0; col < cols; col += GENERATE_TILE_ELEMENTS) {
+			const size_t n = cols - col < GENERATE_TILE_ELEMENTS ? cols - col : GENERATE_TILE_ELEMENTS;
+			const unsigned int* row = row_values(job->m, i, col, n, tile);
+			if (i == begin) {
+				memcpy(acc + col, row, n * sizeof(unsigned int));
+			}
+			else {
+				job->kernel(acc + col, row, 0, acc + col, n);
+			}
+		}
+	}
+	pthread_mutex_lock(&job->lock);
+	if (!job->merged) {
+		memcpy(job->out->data, acc, cols * sizeof(unsigned int));
+		job->merged = true;
+	}
+	else {
+		job->kernel(job->out->data, acc, 0, job->out->data, cols);
+	}
+	pthread_mutex_unlock(&job->lock);
+	free(acc);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Reduces every row or every column of a matrix to one value,
+*		   its sum (wrapping like add), smallest or largest value
+* Input: The matrix,
+*		 true for one value per row, false for one value per column,
+*		 the reduction,
+*		 the result matrix, rows x 1 per row or 1 x cols per column
+* Return: True/False
+***/
+bool reduce_matrix (Matrix_t* m, bool per_row, Matrix_Reduce_t reduce, Matrix_t* out) {
+	TRACE_SCOPE("reduce_matrix", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m || !has_values(m) || !out) {
+		printf("No matrix found\n");
+		return false;
+	}
+	if (reduce >= MATRIX_REDUCE_COUNT) {
+		printf("Not a reduction\n");
+		return false;
+	}
+	if (m->rows == 0 || m->cols == 0) {
+		printf("Matrix (%s) has no values to reduce\n", m->name);
+		return false;
+	}
+	if (per_row ? (out->rows != m->rows || out->cols != 1) : (out->rows != 1 || out->cols != m->cols)) {
+		printf("Result matrix (%s) has the wrong dimensions\n", out->name);
+		return false;
+	}
+	if (!materialize_matrix(out)) {
+		return false;
+	}
+
+	Reduce_Job_t job = { m, reduce_kernels[reduce], out, false, false, PTHREAD_MUTEX_INITIALIZER };
+	run_parallel(per_row ? reduce_rows_task : reduce_cols_task, &job, m->rows, (size_t) m->rows * m->cols);
+	if (job.failed) {
+		return false;
+	}
+	touch_matrix(out);
+	return true;
+}
+
+typedef struct {
+	const Matrix_t* a;
+	const Matrix_t* b;
+	Matrix_t* c;
+	bool by_row;	/* b is one row added to every row, else one column */
+} Broadcast_Job_t;
+
+/*
+ * PURPOSE: adds a row or column vector to a range of rows of a matrix
+ * INPUTS:
+ *	context the Broadcast_Job_t
+ *	begin the first row
+ *	end one past the last row
+ * RETURN:
+ *	void
+ **/
+static void broadcast_add_task (void* context, unsigned int begin, unsigned int end) {
+	const Broadcast_Job_t* job = context;
+	const size_t cols = job->a->cols;
+	unsigned int a_tile[GENERATE_TILE_ELEMENTS];
+	unsigned int b_tile[GENERATE_TILE_ELEMENTS];
+	for (unsigned int i = begin; i < end; ++i) {
+		const unsigned int scalar = job->by_row ? 0 : value_at(job->b, i, 0);
+		for (size_t col = 0; col < cols; col += GENERATE_TILE_ELEMENTS) {
+			const size_t n = cols - col < GENERATE_TILE_ELEMENTS ? cols - col : GENERATE_TILE_ELEMENTS;
+			const unsigned int* a_values = row_values(job->a, i, col, n, a_tile);
+			unsigned int* c_values = job->c->data + (size_t) i * job->c->stride + col;
+			if (job->by_row) {
+				row_add(a_values, row_values(job->b, 0, col, n, b_tile), 0, c_values, n);
+			}
+			else {
+				row_add_scalar(a_values, a_values, scalar, c_values, n);
+			}
+		}
+	}
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Add to seperate matrices together and put the result into a different matrix.
+*		   A 1 x cols or rows x 1 matrix is added to every row or column of the other
+* Input: Two matrices with an equal nubmer of rows and cols, or one of them a row or column vector,
+		 an empty matrix to put the result of the addition of the first two matrices
+* Return: True/False
+***/
+bool add_matrices (Matrix_t* a, Matrix_t* b, Matrix_t* c) {
+	TRACE_SCOPE("add_matrices", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if(!a){
+		printf("Matrix 'a' doesn't exist\n");
+		return false;
+	}
+	if(!b){
+		printf("Matrix 'b' doesnt't exist\n");
+		return false;
+	}
+	if(!c){
+		printf("Matric 'c' doesn't exist\n");
+		return false;
+	}
+	if(!has_values(a)){
+		printf("No data found in matrix 'a'\n");
+		return false;
+	}
+	if(!has_values(b)){
+		printf("No data found in matrix 'b'\n");
+		return false;
+	}	
+	if(!has_values(c)){
+		printf("No room for data in matrix 'c'\n");
+		return false;
+	}
+	
+	/*a single row or column is added to every row or column of the other matrix*/
+	if ((size_t) a->rows * a->cols < (size_t) b->rows * b->cols) {
+		Matrix_t* swap = a;
+		a = b;
+		b = swap;
+	}
+	const bool by_row = b->rows == 1 && b->cols == a->cols && a->rows != 1;
+	const bool by_col = b->cols == 1 && b->rows == a->rows && a->cols != 1;
+	if ((a->rows != b->rows || a->cols != b->cols) && !by_row && !by_col) {
+		printf("Matrices (%s) and (%s) have different dimensions\n", a->name, b->name);
+		return false;
+	}
+	if (a->rows != c->rows || a->cols != c->cols) {
+		return false;
+	}
+	Matrix_t result;
+	if (!materialize_matrix(c) || !begin_result(c, a, b, &result)) {
+		return false;
+	}
+	const Small_Kernels_t* kernels = find_small_kernels(a->rows, a->cols);
+	if (by_row || by_col) {
+		Broadcast_Job_t job = { a, b, &result, by_row };
+		run_parallel(broadcast_add_task, &job, a->rows, (size_t) a->rows * a->cols);
+	}
+	else if (kernels && a->data && b->data && is_dense(a) && is_dense(b) && is_dense(&result)) {
+		kernels->add(a->data, b->data, result.data);
+	}
+	else {
+		apply_row_kernel(row_add, a, b, 0, &result);
+	}
+	finish_result(c, &result);
+	touch_matrix(c);
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Combines two matrices value by value and puts the result into a
+*		   third matrix, which may be one of the inputs
+* Input: The operation (add, sub, mul, and, or, xor or not),
+*		 two matrices with an equal number of rows and cols (b is
+*		 ignored by not and may be NULL),
+*		 the matrix for the result, of the same size
+* Return: True/False
+***/
+bool elementwise_matrices (Matrix_Op_t op, Matrix_t* a, Matrix_t* b, Matrix_t* c) {
+	TRACE_SCOPE("elementwise_matrices", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (op >= MATRIX_OP_ADD_SCALAR) {
+		printf("Not an element-wise operation\n");
+		return false;
+	}
+	if (op == MATRIX_OP_NOT) {
+		b = a;
+	}
+	if (!a || !b || !c) {
+		printf("Matrix doesn't exist\n");
+		return false;
+	}
+	if (!has_values(a) || !has_values(b) || !has_values(c)) {
+		printf("No data found in matrix\n");
+		return false;
+	}
+	if (a->rows != b->rows || a->cols != b->cols
+		|| a->rows != c->rows || a->cols != c->cols) {
+		printf("Matrices have different dimensions\n");
+		return false;
+	}
+	Matrix_t result;
+	if (!materialize_matrix(c) || !begin_result(c, a, b, &result)) {
+		return false;
+	}
+
+	apply_row_kernel(row_kernels[op], a, b, 0, &result);
+	finish_result(c, &result);
+	touch_matrix(c);
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Combines every value of a matrix with a scalar and puts the
+*		   result into a second matrix, which may be the input
+* Input: The operation (add_scalar, mul_scalar, shl_scalar or shr_scalar),
+*		 the matrix,
+*		 the scalar,
+*		 the matrix for the result, of the same size
+* Return: True/False
+***/
+bool scalar_matrix (Matrix_Op_t op, Matrix_t* a, unsigned int scalar, Matrix_t* c) {
+	TRACE_SCOPE("scalar_matrix", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (op < MATRIX_OP_ADD_SCALAR || op >= MATRIX_OP_COUNT) {
+		printf("Not a scalar operation\n");
+		return false;
+	}
+	if ((op == MATRIX_OP_SHL_SCALAR || op == MATRIX_OP_SHR_SCALAR)
+		&& scalar >= sizeof(unsigned int) * 8) {
+		printf("Invalid range for shift\n");
+		return false;
+	}
+	if (!a || !c) {
+		printf("Matrix doesn't exist\n");
+		return false;
+	}
+	if (!has_values(a) || !has_values(c)) {
+		printf("No data found in matrix\n");
+		return false;
+	}
+	if (a->rows != c->rows || a->cols != c->cols) {
+		printf("Matrices have different dimensions\n");
+		return false;
+	}
+	Matrix_t result;
+	if (!materialize_matrix(c) || !begin_result(c, a, a, &result)) {
+		return false;
+	}
+
+	apply_row_kernel(row_kernels[op], a, a, scalar, &result);
+	finish_result(c, &result);
+	touch_matrix(c);
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Runs one element-wise operation over a single run of values,
+*		   for callers that walk matrices in their own order
+* Input: The operation,
+*		 the first operand values,
+*		 the second operand values (ignored by unary and scalar operations),
+*		 the scalar operand,
+*		 where the n results go, which may be one of the operands
+*		 the number of values
+* Return: void
+***/
+void apply_row_operation (Matrix_Op_t op, const unsigned int* a, const unsigned int* b,
+			unsigned int scalar, unsigned int* c, size_t n) {
+	if (op >= MATRIX_OP_COUNT || !a || !c) {
+		return;
+	}
+	row_kernels[op](a, b ? b : a, scalar, c, n);
+}
+
+/*
+ * Convolution works on output tiles of CONVOLVE_TILE_ROWS x
+ * CONVOLVE_TILE_COLS values. Each tile first gathers the source values it
+ * needs, border included, into a padded copy so the inner loops never
+ * test for edges; the copy and the running sums stay in cache.
+ */
+#define CONVOLVE_TILE_ROWS 64
+#define CONVOLVE_TILE_COLS 256
+
+typedef struct {
+	const Matrix_t* src;
+	Matrix_Border_t border;
+	unsigned int kernel_rows;
+	unsigned int kernel_cols;
+	const unsigned int* weights;	/* kernel_rows x kernel_cols, dense */
+	const unsigned int* col_weights;	/* separable factors or NULL */
+	const unsigned int* row_weights;
+	unsigned int* out;
+	size_t out_stride;
+	unsigned int col_tiles;
+	bool failed;
+	pthread_mutex_t lock;
+} Convolve_Job_t;
+
+/*
+ * PURPOSE: computes a row of weighted sums, out[j] = sum of w[t] * in[t][j],
+ *	keeping the sums in registers so every tap costs no extra memory pass
+ * INPUTS:
+ *	out the results
+ *	in one row of values per tap
+ *	w one weight per tap
+ *	taps the number of taps
+ *	n the number of results
+ * RETURN:
+ *	void
+ **/
+static SIMD_CLONES void weighted_sum_row (unsigned int* out, const unsigned int* const* in,
+			const unsigned int* w, unsigned int taps, size_t n) {
+	size_t j = 0;
+	for (; j + VEC_LANES <= n; j += VEC_LANES) {
+		Vec_u32_t sum = { 0 };
+		for (unsigned int t = 0; t < taps; ++t) {
+			Vec_u32_t x;
+			memcpy(&x, in[t] + j, sizeof(x));
+			sum += x * w[t];
+		}
+		memcpy(out + j, &sum, sizeof(sum));
+	}
+	for (; j < n; ++j) {
+		unsigned int sum = 0;
+		for (unsigned int t = 0; t < taps; ++t) {
+			sum += in[t][j] * w[t];
+		}
+		out[j] = sum;
+	}
+}
+
+/*
+ * PURPOSE: maps a row or col index that may lie outside the matrix back
+ *	into it following the border mode
+ * INPUTS:
+ *	index the wanted index
+ *	size the number of rows or cols
+ *	border how outside values are made up
+ * RETURN:
+ *	the index to read, -1 for a zero value
+ **/
+static long long border_index (long long index, unsigned int size, Matrix_Border_t border) {
+	if (index >= 0 && index < size) {
+		return index;
+	}
+	if (border == MATRIX_BORDER_CLAMP) {
+		return index < 0 ? 0 : (long long) size - 1;
+	}
+	if (border == MATRIX_BORDER_WRAP) {
+		return ((index % size) + size) % size;
+	}
+	return -1;
+}
+
+/*
+ * PURPOSE: copies the source values a tile reads into a padded buffer;
+ *	the tile itself always lies inside the source
+ * INPUTS:
+ *	job the convolution
+ *	padded receives rows x cols values
+ *	first_row the source row of the first padded row, may be outside
+ *	first_col the source col of the first padded col, may be outside
+ *	rows the number of padded rows
+ *	cols the number of padded cols
+ * RETURN:
+ *	void
+ **/
+static void gather_tile (const Convolve_Job_t* job, unsigned int* padded, long long first_row,
+			long long first_col, unsigned int rows, unsigned int cols) {
+	const Matrix_t* src = job->src;
+	const long long inner_begin = first_col < 0 ? 0 : first_col;
+	const long long inner_end = first_col + cols > src->cols ? src->cols : first_col + cols;
+	for (unsigned int r = 0; r < rows; ++r) {
+		unsigned int* dest = padded + (size_t) r * cols;
+		const long long row = border_index(first_row + r, src->rows, job->border);
+		if (row < 0) {
+			memset(dest, 0, cols * sizeof(unsigned int));
+			continue;
+		}
+		if (src->data) {
+			memcpy(dest + (inner_begin - first_col), src->data + (size_t) row * src->stride + inner_begin,
+					(inner_end - inner_begin) * sizeof(unsigned int));
+		}
+		else {
+			generate_matrix_values(src, (unsigned long long) row * src->cols + inner_begin,
+					inner_end - inner_begin, dest + (inner_begin - first_col));
+		}
+		for (long long c = first_col; c < inner_begin; ++c) {
+			const long long col = border_index(c, src->cols, job->border);
+			dest[c - first_col] = col < 0 ? 0 : value_at(src, row, col);
+		}
+		for (long long c = inner_end; c < first_col + cols; ++c) {
+			const long long col = border_index(c, src->cols, job->border);
+			dest[c - first_col] = col < 0 ? 0 : value_at(src, row, col);
+		}
+	}
+}
+
+/*
+ * PURPOSE: computes a range of output tiles
+ * INPUTS:
+ *	context the Convolve_Job_t
+ *	begin the first tile, counted row of tiles by row of tiles
+ *	end one past the last tile
+ * RETURN:
+ *	void
+ **/
+static void convolve_tiles (void* context, unsigned int begin, unsigned int end) {
+	Convolve_Job_t* job = context;
+	const unsigned int kr = job->kernel_rows;
+	const unsigned int kc = job->kernel_cols;
+	const size_t padded_cols = CONVOLVE_TILE_COLS + kc - 1;
+	unsigned int* padded = malloc((CONVOLVE_TILE_ROWS + kr - 1) * padded_cols * sizeof(unsigned int));
+	unsigned int* passed = job->row_weights
+			? malloc((CONVOLVE_TILE_ROWS + kr - 1) * CONVOLVE_TILE_COLS * sizeof(unsigned int)) : NULL;
+	const unsigned int** in = malloc(((size_t) kr * kc + kr + kc) * sizeof(unsigned int*));
+	unsigned int* w = malloc(((size_t) kr * kc + kr + kc) * sizeof(unsigned int));
+	if (!padded || (job->row_weights && !passed) || !in || !w) {
+		printf("Not enough memory to convolve\n");
+		free(padded);
+		free(passed);
+		free(in);
+		free(w);
+		pthread_mutex_lock(&job->lock);
+		job->failed = true;
+		pthread_mutex_unlock(&job->lock);
+		return;
+	}
+
+	for (unsigned int t = begin; t < end; ++t) {
+		const unsigned int row0 = (t / job->col_tiles) * CONVOLVE_TILE_ROWS;
+		const unsigned int col0 = (t % job->col_tiles) * CONVOLVE_TILE_COLS;
+		const unsigned int rows = job->src->rows - row0 < CONVOLVE_TILE_ROWS
+				? job->src->rows - row0 : CONVOLVE_TILE_ROWS;
+		const unsigned int cols = job->src->cols - col0 < CONVOLVE_TILE_COLS
+				? job->src->cols - col0 : CONVOLVE_TILE_COLS;
+
+		/*tiles away from the border read a stored source in place*/
+		const long long first_row = (long long) row0 - kr / 2;
+		const long long first_col = (long long) col0 - kc / 2;
+		const unsigned int* base = padded;
+		size_t pitch = cols + kc - 1;
+		if (!job->src->data || first_row < 0 || first_row + rows + kr - 1 > job->src->rows
+			|| first_col < 0 || first_col + cols + kc - 1 > job->src->cols) {
+			gather_tile(job, padded, first_row, first_col, rows + kr - 1, cols + kc - 1);
+		}
+		else {
+			base = job->src->data + (size_t) first_row * job->src->stride + first_col;
+			pitch = job->src->stride;
+		}
+
+		/*taps with a zero weight are left out*/
+		unsigned int taps = 0;
+		if (passed) {
+			/*separable: one pass along the rows, then one down the cols*/
+			for (unsigned int v = 0; v < kc; ++v) {
+				if (job->row_weights[v]) {
+					w[taps++] = job->row_weights[v];
+				}
+			}
+			for (unsigned int r = 0; r < rows + kr - 1; ++r) {
+				for (unsigned int v = 0, tap = 0; v < kc; ++v) {
+					if (job->row_weights[v]) {
+						in[tap++] = base + (size_t) r * pitch + v;
+					}
+				}
+				weighted_sum_row(passed + (size_t) r * cols, in, w, taps, cols);
+			}
+			taps = 0;
+			for (unsigned int u = 0; u < kr; ++u) {
+				if (job->col_weights[u]) {
+					w[taps++] = job->col_weights[u];
+				}
+			}
+			for (unsigned int i = 0; i < rows; ++i) {
+				for (unsigned int u = 0, tap = 0; u < kr; ++u) {
+					if (job->col_weights[u]) {
+						in[tap++] = passed + (size_t) (i + u) * cols;
+					}
+				}
+				weighted_sum_row(job->out + (size_t) (row0 + i) * job->out_stride + col0, in, w, taps, cols);
+			}
+			continue;
+		}
+
+		for (unsigned int k = 0; k < kr * kc; ++k) {
+			if (job->weights[k]) {
+				w[taps++] = job->weights[k];
+			}
+		}
+		for (unsigned int i = 0; i < rows; ++i) {
+			unsigned int tap = 0;
+			for (unsigned int k = 0; k < kr * kc; ++k) {
+				if (job->weights[k]) {
+					in[tap++] = base + (size_t) (i + k / kc) * pitch + k % kc;
+				}
+			}
+			weighted_sum_row(job->out + (size_t) (row0 + i) * job->out_stride + col0, in, w, taps, cols);
+		}
+	}
+	free(padded);
+	free(passed);
+	free(in);
+	free(w);
+}
+
+/*
+ * PURPOSE: splits a kernel into a column and a row of integer weights
+ *	whose products give back every kernel weight, as for box and
+ *	binomial filters
+ * INPUTS:
+ *	weights the kernel, rows x cols
+ *	rows the number of kernel rows
+ *	cols the number of kernel cols
+ *	col_weights receives rows weights
+ *	row_weights receives cols weights
+ * RETURN:
+ *	true if the kernel is separable
+ **/
+static bool separate_kernel (const unsigned int* weights, unsigned int rows, unsigned int cols,
+			unsigned int* col_weights, unsigned int* row_weights) {
+	unsigned int base = 0;
+	while (base < rows * cols && !weights[base]) {
+		++base;
+	}
+	if (base == rows * cols) {
+		return false;
+	}
+
+	/*the row holding the first non zero weight, divided by its gcd*/
+	const unsigned int* row = weights + (base / cols) * cols;
+	unsigned int gcd = 0;
+	for (unsigned int v = 0; v < cols; ++v) {
+		unsigned int a = gcd, b = row[v];
+		while (b) {
+			unsigned int t = a % b;
+			a = b;
+			b = t;
+		}
+		gcd = a;
+	}
+	for (unsigned int v = 0; v < cols; ++v) {
+		row_weights[v] = row[v] / gcd;
+	}
+	const unsigned int pivot = base % cols;
+	for (unsigned int u = 0; u < rows; ++u) {
+		if (weights[(size_t) u * cols + pivot] % row_weights[pivot]) {
+			return false;
+		}
+		col_weights[u] = weights[(size_t) u * cols + pivot] / row_weights[pivot];
+		for (unsigned int v = 0; v < cols; ++v) {
+			if ((unsigned long long) col_weights[u] * row_weights[v] != weights[(size_t) u * cols + v]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Slides a kernel over a matrix: every result value is the sum
+*		   of the kernel weights times the values under them, with the
+*		   kernel centred on the value (not flipped). Separable kernels
+*		   take two one dimensional passes.
+* Input: The source matrix,
+*		 the kernel matrix,
+*		 how values outside the source are made up,
+*		 the result matrix of the source size, which may share data
+*		 with the source
+* Return: True/False
+***/
+bool convolve_matrix (Matrix_t* src, Matrix_t* kernel, Matrix_Border_t border, Matrix_t* dst) {
+	TRACE_SCOPE("convolve_matrix", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!src || !kernel || !dst) {
+		printf("No matrix found\n");
+		return false;
+	}
+	if (!has_values(src) || !has_values(kernel) || !has_values(dst)) {
+		printf("No data found in matrix\n");
+		return false;
+	}
+	if (src->rows != dst->rows || src->cols != dst->cols) {
+		printf("Destination matrix has different dimensions\n");
+		return false;
+	}
+	if (border != MATRIX_BORDER_ZERO && border != MATRIX_BORDER_CLAMP && border != MATRIX_BORDER_WRAP) {
+		printf("Invalid border mode\n");
+		return false;
+	}
+	if (!materialize_matrix(dst)) {
+		return false;
+	}
+
+	const unsigned int kr = kernel->rows;
+	const unsigned int kc = kernel->cols;
+	unsigned int* weights = malloc(((size_t) kr * kc + kr + kc) * sizeof(unsigned int));
+	if (!weights) {
+		printf("Not enough memory to convolve\n");
+		return false;
+	}
+	for (unsigned int u = 0; u < kr; ++u) {
+		if (kernel->data) {
+			memcpy(weights + (size_t) u * kc, kernel->data + (size_t) u * kernel->stride, kc * sizeof(unsigned int));
+		}
+		else {
+			generate_matrix_values(kernel, (unsigned long long) u * kc, kc, weights + (size_t) u * kc);
+		}
+	}
+	unsigned int* col_weights = weights + (size_t) kr * kc;
+	unsigned int* row_weights = col_weights + kr;
+	const bool separable = (kr > 1 || kc > 1) && separate_kernel(weights, kr, kc, col_weights, row_weights);
+
+	/*results that would overwrite source values still to be read go to a scratch copy first*/
+	const Matrix_t* src_owner = src->parent ? src->parent : src;
+	const Matrix_t* dst_owner = dst->parent ? dst->parent : dst;
+	unsigned int* out = dst->data;
+	size_t out_stride = dst->stride;
+	if (src_owner == dst_owner) {
+		out = malloc((size_t) dst->rows * dst->cols * sizeof(unsigned int));
+		out_stride = dst->cols;
+		if (!out) {
+			printf("Not enough memory to convolve\n");
+			free(weights);
+			return false;
+		}
+	}
+
+	const unsigned int row_tiles = (src->rows + CONVOLVE_TILE_ROWS - 1) / CONVOLVE_TILE_ROWS;
+	Convolve_Job_t job = { src, border, kr, kc, weights, separable ? col_weights : NULL,
+			separable ? row_weights : NULL, out, out_stride,
+			(src->cols + CONVOLVE_TILE_COLS - 1) / CONVOLVE_TILE_COLS, false, PTHREAD_MUTEX_INITIALIZER };
+	run_parallel(convolve_tiles, &job, row_tiles * job.col_tiles,
+			(size_t) src->rows * src->cols * (separable ? kr + kc : kr * kc));
+	if (job.failed) {
+		if (out != dst->data) {
+			free(out);
+		}
+		free(weights);
+		return false;
+	}
+
+	if (out != dst->data) {
+		for (unsigned int i = 0; i < dst->rows; ++i) {
+			memcpy(dst->data + (size_t) i * dst->stride, out + (size_t) i * dst->cols,
+					dst->cols * sizeof(unsigned int));
+		}
+		free(out);
+	}
+	free(weights);
+	touch_matrix(dst);
+	return true;
+}
+
+/* histograms keep one private copy of the bins per thread */
+#define HISTOGRAM_MAX_BINS (1 << 16)
+
+/* row sorting: 8 bit digits, keys split into at most RADIX_BLOCKS blocks */
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_BLOCKS 64
+#define RADIX_BLOCK_MIN 4096
+
+typedef struct {
+	const Matrix_t* m;
+	unsigned int min;
+	unsigned int max;
+	unsigned long long scale;	/* bin of v is ((v - min) * scale) >> 32 */
+	unsigned int bins;
+	unsigned long long* counts;
+	bool failed;
+	pthread_mutex_t lock;
+} Histogram_Job_t;
+
+/*
+ * PURPOSE: finds the smallest and largest value of a range of rows and
+ *	merges them into the job
+ * INPUTS:
+ *	context the Histogram_Job_t
+ *	begin the first row
+ *	end one past the last row
+ * RETURN:
+ *	void
+ **/
+static void value_range_task (void* context, unsigned int begin, unsigned int end) {
+	Histogram_Job_t* job = context;
+	unsigned int tile[GENERATE_TILE_ELEMENTS];
+	unsigned int min = UINT_MAX, max = 0;
+	for (unsigned int i = begin; i < end; ++i) {
+		for (size_t col = 0; col < job->m->cols; col += GENERATE_TILE_ELEMENTS) {
+			const size_t n = job->m->cols - col < GENERATE_TILE_ELEMENTS ? job->m->cols - col : GENERATE_TILE_ELEMENTS;
+			const unsigned int* row = row_values(job->m, i, col, n, tile);
+			for (size_t j = 0; j < n; ++j) {
+				min = row[j] < min ? row[j] : min;
+				max = row[j] > max ? row[j] : max;
+			}
+		}
+	}
+	pthread_mutex_lock(&job->lock);
+	job->min = min < job->min ? min : job->min;
+	job->max = max > job->max ? max : job->max;
+	pthread_mutex_unlock(&job->lock);
+}
+
+/*
+ * PURPOSE: counts a range of rows into private bins, then adds them to
+ *	the shared bins once
+ * INPUTS:
+ *	context the Histogram_Job_t
+ *	begin the first row
+ *	end one past the last row
+ * RETURN:
+ *	void
+ **/
+static void histogram_task (void* context, unsigned int begin, unsigned int end) {
+	Histogram_Job_t* job = context;
+	unsigned long long* counts = calloc(job->bins, sizeof(unsigned long long));
+	if (!counts) {
+		printf("Not enough memory for histogram bins\n");
+		pthread_mutex_lock(&job->lock);
+		job->failed = true;
+		pthread_mutex_unlock(&job->lock);
+		return;
+	}
+	unsigned int tile[GENERATE_TILE_ELEMENTS];
+	for (unsigned int i = begin; i < end; ++i) {
+		for (size_t col = 0; col < job->m->cols; col += GENERATE_TILE_ELEMENTS) {
+			const size_t n = job->m->cols - col < GENERATE_TILE_ELEMENTS ? job->m->cols - col : GENERATE_TILE_ELEMENTS;
+			const unsigned int* row = row_values(job->m, i, col, n, tile);
+			for (size_t j = 0; j < n; ++j) {
+				++counts[((unsigned long long) (row[j] - job->min) * job->scale) >> 32];
+			}
+		}
+	}
+	pthread_mutex_lock(&job->lock);
+	for (unsigned int b = 0; b < job->bins; ++b) {
+		job->counts[b] += counts[b];
+	}
+	pthread_mutex_unlock(&job->lock);
+	free(counts);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Counts the values of a matrix into bins of nearly equal width
+*		   spanning its smallest to its largest value
+* Input: The matrix,
+*		 the number of bins,
+*		 receives the count of every bin,
+*		 receives bins + 1 edges, bin b counts values in [edges[b], edges[b + 1])
+* Return: True/False
+***/
+bool histogram_matrix (Matrix_t* m, unsigned int bins, unsigned long long* counts,
+			unsigned long long* edges) {
+	TRACE_SCOPE("histogram_matrix", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m || !has_values(m) || !counts || !edges) {
+		printf("No matrix found\n");
+		return false;
+	}
+	if (bins == 0 || bins > HISTOGRAM_MAX_BINS) {
+		printf("Number of bins must be between 1 and %u\n", HISTOGRAM_MAX_BINS);
+		return false;
+	}
+
+	Histogram_Job_t job = { m, UINT_MAX, 0, 0, bins, counts, false, PTHREAD_MUTEX_INITIALIZER };
+	const size_t elements = (size_t) m->rows * m->cols;
+	run_parallel(value_range_task, &job, m->rows, elements);
+	if (job.min > job.max) {
+		job.min = job.max = 0;
+	}
+
+	/*scale <= bins * 2^32 / span keeps the largest value in the last bin*/
+	const unsigned long long span = (unsigned long long) job.max - job.min + 1;
+	job.scale = ((unsigned long long) bins << 32) / span;
+	memset(counts, 0, bins * sizeof(unsigned long long));
+	run_parallel(histogram_task, &job, m->rows, elements);
+	if (job.failed) {
+		return false;
+	}
+
+	for (unsigned int b = 0; b < bins; ++b) {
+		edges[b] = job.min + ((((unsigned long long) b << 32) + job.scale - 1) / job.scale);
+	}
+	edges[bins] = (unsigned long long) job.max + 1;
+	return true;
+}
+
+typedef struct {
+	unsigned int value;
+	unsigned long long index;	/* row * cols + col */
+} Topk_Entry_t;
+
+typedef struct {
+	const Matrix_t* m;
+	unsigned int k;
+	Topk_Entry_t* heap;
+	unsigned int size;
+	bool failed;
+	pthread_mutex_t lock;
+} Topk_Job_t;
+
+/*
+ * PURPOSE: orders top-k candidates: larger values first, and among equal
+ *	values the one met first, so results do not depend on threading
+ * INPUTS:
+ *	a the first entry
+ *	b the second entry
+ * RETURN:
+ *	true if a ranks below b
+ **/
+static bool topk_below (const Topk_Entry_t* a, const Topk_Entry_t* b) {
+	return a->value < b->value || (a->value == b->value && a->index > b->index);
+}
+
+/*
+ * PURPOSE: restores the heap order below a slot of a heap whose root is
+ *	its lowest ranked entry
+ * INPUTS:
+ *	heap the entries
+ *	size the number of entries
+ *	slot where an entry was replaced
+ * RETURN:
+ *	void
+ **/
+static void topk_sift_down (Topk_Entry_t* heap, unsigned int size, unsigned int slot) {
+	while (true) {
+		unsigned int lowest = slot;
+		const unsigned int left = 2 * slot + 1, right = 2 * slot + 2;
+		if (left < size && topk_below(&heap[left], &heap[lowest])) {
+			lowest = left;
+		}
+		if (right < size && topk_below(&heap[right], &heap[lowest])) {
+			lowest = right;
+		}
+		if (lowest == slot) {
+			return;
+		}
+		Topk_Entry_t swap = heap[slot];
+		heap[slot] = heap[lowest];
+		heap[lowest] = swap;
+		slot = lowest;
+	}
+}
+
+/*
+ * PURPOSE: offers an entry to a heap that keeps the k best entries
+ * INPUTS:
+ *	heap room for k entries
+ *	size the number of entries, updated
+ *	k the number of entries to keep
+ *	entry the candidate
+ * RETURN:
+ *	void
+ **/
+static void topk_offer (Topk_Entry_t* heap, unsigned int* size, unsigned int k, Topk_Entry_t entry) {
+	if (*size < k) {
+		unsigned int slot = (*size)++;
+		heap[slot] = entry;
+		while (slot > 0 && topk_below(&heap[slot], &heap[(slot - 1) / 2])) {
+			Topk_Entry_t swap = heap[slot];
+			heap[slot] = heap[(slot - 1) / 2];
+			heap[(slot - 1) / 2] = swap;
+			slot = (slot - 1) / 2;
+		}
+	}
+	else if (topk_below(&heap[0], &entry)) {
+		heap[0] = entry;
+		topk_sift_down(heap, *size, 0);
+	}
+}
+
+/*
+ * PURPOSE: keeps the k best values of a range of rows in a private heap
+ *	and offers them to the shared heap once
+ * INPUTS:
+ *	context the Topk_Job_t
+ *	begin the first row
+ *	end one past the last row
+ * RETURN:
+ *	void
+ **/
+static void topk_task (void* context, unsigned int begin, unsigned int end) {
+	Topk_Job_t* job = context;
+	Topk_Entry_t* heap = malloc((size_t) job->k * sizeof(Topk_Entry_t));
+	if (!heap) {
+		printf("Not enough memory for top values\n");
+		pthread_mutex_lock(&job->lock);
+		job->failed = true;
+		pthread_mutex_unlock(&job->lock);
+		return;
+	}
+	unsigned int tile[GENERATE_TILE_ELEMENTS];
+	unsigned int size = 0;
+	for (unsigned int i = begin; i < end; ++i) {
+		for (size_t col = 0; col < job->m->cols; col += GENERATE_TILE_ELEMENTS) {
+			const size_t n = job->m->cols - col < GENERATE_TILE_ELEMENTS ? job->m->cols - col : GENERATE_TILE_ELEMENTS;
+			const unsigned int* row = row_values(job->m, i, col, n, tile);
+			for (size_t j = 0; j < n; ++j) {
+				/*most values lose against a full heap, test before building the entry*/
+				if (size == job->k && row[j] < heap[0].value) {
+					continue;
+				}
+				Topk_Entry_t entry = { row[j], (unsigned long long) i * job->m->cols + col + j };
+				topk_offer(heap, &size, job->k, entry);
+			}
+		}
+	}
+	pthread_mutex_lock(&job->lock);
+	for (unsigned int e = 0; e < size; ++e) {
+		topk_offer(job->heap, &job->size, job->k, heap[e]);
+	}
+	pthread_mutex_unlock(&job->lock);
+	free(heap);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Finds the k largest values of a matrix with per thread heaps,
+*		   without sorting the matrix
+* Input: The matrix,
+*		 how many values to find, at most the number of values,
+*		 receives the values from largest down,
+*		 receives the row of every value,
+*		 receives the col of every value
+* Return: True/False
+***/
+bool topk_matrix (Matrix_t* m, unsigned int k, unsigned int* values, unsigned int* rows,
+			unsigned int* cols) {
+	TRACE_SCOPE("topk_matrix", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m || !has_values(m) || !values || !rows || !cols) {
+		printf("No matrix found\n");
+		return false;
+	}
+	if (k == 0 || k > (unsigned long long) m->rows * m->cols) {
+		printf("k must be between 1 and the number of values\n");
+		return false;
+	}
+
+	Topk_Job_t job = { m, k, malloc((size_t) k * sizeof(Topk_Entry_t)), 0, false, PTHREAD_MUTEX_INITIALIZER };
+	if (!job.heap) {
+		printf("Not enough memory for top values\n");
+		return false;
+	}
+	run_parallel(topk_task, &job, m->rows, (size_t) m->rows * m->cols);
+
+	/*popping the lowest ranked entry fills the results from the back*/
+	for (unsigned int e = job.size; e-- > 0; ) {
+		values[e] = job.heap[0].value;
+		rows[e] = job.heap[0].index / m->cols;
+		cols[e] = job.heap[0].index % m->cols;
+		job.heap[0] = job.heap[e];
+		topk_sift_down(job.heap, e, 0);
+	}
+	free(job.heap);
+	return !job.failed && job.size == k;
+}
+
+typedef struct {
+	const unsigned int* keys;
+	const unsigned int* order;
+	unsigned int* keys_out;
+	unsigned int* order_out;
+	unsigned int count;
+	unsigned int blocks;
+	unsigned int shift;
+	unsigned int* offsets;	/* blocks x RADIX_BUCKETS */
+} Radix_Job_t;
+
+/*
+ * PURPOSE: counts the current digit of the keys of a range of blocks
+ * INPUTS:
+ *	context the Radix_Job_t
+ *	begin the first block
+ *	end one past the last block
+ * RETURN:
+ *	void
+ **/
+static void radix_count_task (void* context, unsigned int begin, unsigned int end) {
+	Radix_Job_t* job = context;
+	for (unsigned int b = begin; b < end; ++b) {
+		unsigned int* counts = job->offsets + (size_t) b * RADIX_BUCKETS;
+		memset(counts, 0, RADIX_BUCKETS * sizeof(unsigned int));
+		const unsigned int first = (unsigned long long) job->count * b / job->blocks;
+		const unsigned int last = (unsigned long long) job->count * (b + 1) / job->blocks;
+		for (unsigned int i = first; i < last; ++i) {
+			++counts[(job->keys[i] >> job->shift) & (RADIX_BUCKETS - 1)];
+		}
+	}
+}
+
+/*
+ * PURPOSE: moves the keys of a range of blocks to the slots their digit
+ *	and block were given, keeping equal digits in order
+ * INPUTS:
+ *	context the Radix_Job_t
+ *	begin the first block
+ *	end one past the last block
+ * RETURN:
+ *	void
+ **/
+static void radix_scatter_task (void* context, unsigned int begin, unsigned int end) {
+	Radix_Job_t* job = context;
+	for (unsigned int b = begin; b < end; ++b) {
+		unsigned int* next = job->offsets + (size_t) b * RADIX_BUCKETS;
+		const unsigned int first = (unsigned long long) job->count * b / job->blocks;
+		const unsigned int last = (unsigned long long) job->count * (b + 1) / job->blocks;
+		for (unsigned int i = first; i < last; ++i) {
+			const unsigned int slot = next[(job->keys[i] >> job->shift) & (RADIX_BUCKETS - 1)]++;
+			job->keys_out[slot] = job->keys[i];
+			job->order_out[slot] = job->order[i];
+		}
+	}
+}
+
+typedef struct {
+	const Matrix_t* m;
+	const unsigned int* order;
+	unsigned int* sorted;
+} Row_Gather_Job_t;
+
+/*
+ * PURPOSE: copies rows of a matrix into their sorted places
+ * INPUTS:
+ *	context the Row_Gather_Job_t
+ *	begin the first sorted row
+ *	end one past the last sorted row
+ * RETURN:
+ *	void
+ **/
+static void gather_rows_task (void* context, unsigned int begin, unsigned int end) {
+	Row_Gather_Job_t* job = context;
+	for (unsigned int i = begin; i < end; ++i) {
+		memcpy(job->sorted + (size_t) i * job->m->cols, job->m->data + (size_t) job->order[i] * job->m->stride,
+				job->m->cols * sizeof(unsigned int));
+	}
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Sorts the rows of a matrix by the values of one column from
+*		   smallest to largest, keeping rows with equal values in order,
+*		   with a parallel least significant digit radix sort
+* Input: The matrix,
+*		 the column to sort by
+* Return: True/False
+***/
+bool sort_rows_matrix (Matrix_t* m, unsigned int col) {
+	TRACE_SCOPE("sort_rows_matrix", "compute");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m || !has_values(m)) {
+		printf("No matrix found\n");
+		return false;
+	}
+	if (col >= m->cols) {
+		printf("Column %u is outside of (%u,%u)\n", col, m->rows, m->cols);
+		return false;
+	}
+	if (!materialize_matrix(m)) {
+		return false;
+	}
+
+	const unsigned int n = m->rows;
+	unsigned int blocks = n / RADIX_BLOCK_MIN + 1;
+	blocks = blocks > RADIX_BLOCKS ? RADIX_BLOCKS : blocks;
+	unsigned int* keys = malloc((size_t) n * 4 * sizeof(unsigned int));
+	unsigned int* offsets = malloc((size_t) blocks * RADIX_BUCKETS * sizeof(unsigned int));
+	unsigned int* sorted = malloc((size_t) n * m->cols * sizeof(unsigned int));
+	if (!keys || !offsets || !sorted) {
+		printf("Not enough memory to sort rows\n");
+		free(keys);
+		free(offsets);
+		free(sorted);
+		return false;
+	}
+	unsigned int* order = keys + n;
+	for (unsigned int i = 0; i < n; ++i) {
+		keys[i] = m->data[(size_t) i * m->stride + col];
+		order[i] = i;
+	}
+
+	Radix_Job_t job = { keys, order, keys + 2 * (size_t) n, keys + 3 * (size_t) n, n, blocks, 0, offsets };
+	for (job.shift = 0; job.shift < sizeof(unsigned int) * 8; job.shift += RADIX_BITS) {
+		run_parallel(radix_count_task, &job, blocks, n);
+
+		/*bucket by bucket, block by block: where each block starts writing a digit*/
+		unsigned int slot = 0;
+		bool one_bucket = false;
+		for (unsigned int d = 0; d < RADIX_BUCKETS; ++d) {
+			const unsigned int bucket_start = slot;
+			for (unsigned int b = 0; b < blocks; ++b) {
+				const unsigned int count = offsets[(size_t) b * RADIX_BUCKETS + d];
+				offsets[(size_t) b * RADIX_BUCKETS + d] = slot;
+				slot += count;
+			}
+			one_bucket = one_bucket || slot - bucket_start == n;
+		}
+		if (one_bucket) {
+			continue;	/* every key has this digit, the pass would change nothing */
+		}
+		run_parallel(radix_scatter_task, &job, blocks, n);
+
+		const unsigned int* swap_keys = job.keys;
+		const unsigned int* swap_order = job.order;
+		job.keys = job.keys_out;
+		job.order = job.order_out;
+		job.keys_out = (unsigned int*) swap_keys;
+		job.order_out = (unsigned int*) swap_order;
+	}
+
+	Row_Gather_Job_t gather = { m, job.order, sorted };
+	run_parallel(gather_rows_task, &gather, n, (size_t) n * m->cols);
+	for (unsigned int i = 0; i < n; ++i) {
+		memcpy(m->data + (size_t) i * m->stride, sorted + (size_t) i * m->cols, m->cols * sizeof(unsigned int));
+	}
+	touch_matrix(m);
+
+	free(keys);
+	free(offsets);
+	free(sorted);
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Prints a matrix to the screen
+* Input: a matrix to display
+* Return: void
+***/
+void display_matrix (Matrix_t* m) {
+	TRACE_SCOPE("display_matrix", "io");
+	
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m){
+		printf("Matrix not found\n");
+		return;
+	}
+	if(!has_values(m)){
+		printf("No data found in matrix\n");
+		return;
+	}
+	printf("\nMatrix Contents (%s):\n", m->name);
+	printf("DIM = (%u,%u)\n", m->rows, m->cols);
+	for (int i = 0; i < m->rows; ++i) {
+		for (int j = 0; j < m->cols; ++j) {
+			printf("%u ", value_at(m, i, j));
+		}
+		printf("\n");
+	}
+	printf("\n");
+
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Read a matrix from a file, checking the values against the
+*		   checksum stored with them
+* Inputs: a file on the system,
+*		  where the new matrix goes
+* Return: True/False
+***/
+bool read_matrix (const char* matrix_input_filename, Matrix_t** m) {
+	TRACE_SCOPE("read_matrix", "io");
+	
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m){
+		printf("Matrix does not exist\n");
+		return false;
+	}
+
+	Matrix_File_t file;
+	if (!open_matrix_file(matrix_input_filename, &file)) {
+		printf("FAILED TO READ MATRIX FILE %s\n", matrix_input_filename);
+		if (errno == EACCES ) {
+			perror("DO NOT HAVE ACCESS TO FILE\n");
+		}
+		else if (errno == ENOENT) {
+			perror("FILE DOES NOT EXIST\n");
+		}
+		return false;
+	}
+
+	if (!create_matrix(m,file.name,file.rows,file.cols)) {
+		close(file.fd);
+		return false;
+	}
+
+	if (!read_matrix_values(&file, (*m)->data, (size_t) file.rows * file.cols, 0)) {
+		printf("FAILED TO READ MATRIX DATA\n");
+		destroy_matrix(m);
+		close(file.fd);
+		return false;
+	}
+	close(file.fd);
+	if (!matrix_file_intact(&file)) {
+		printf("CHECKSUM MISMATCH IN %s\n", matrix_input_filename);
+		destroy_matrix(m);
+		return false;
+	}
+	if (!file.has_checksum) {
+		printf("Matrix file %s has no checksum\n", matrix_input_filename);
+	}
+	touch_matrix(*m);
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Reads only the name of the matrix held in a matrix file
+* Input: The file,
+*		 where the name goes, MATRIX_NAME_LEN bytes
+* Return: True if the file has a valid matrix header
+***/
+bool read_matrix_name (const char* matrix_input_filename, char* name) {
+	Matrix_File_t file;
+	if (!matrix_input_filename || !name || !open_matrix_file(matrix_input_filename, &file)) {
+		return false;
+	}
+	close(file.fd);
+	memcpy(name, file.name, MATRIX_NAME_LEN);
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Writes a matrix to a file followed by the checksum of
+*		   everything written
+* Input: The desired filepath,
+*		 matrix to write to the file
+* Return: True/False
+***/
+bool write_matrix (const char* matrix_output_filename, Matrix_t* m) {
+	TRACE_SCOPE("write_matrix", "io");
+	
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m){
+		printf("Matrix does not exist\n");
+		return false;
+	}
+	if(!has_values(m)){
+		printf("Not enough space in matrix to store data\n");
+		return false;
+	}
+
+	int fd = open (matrix_output_filename, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	/* ERROR HANDLING USING errorno*/
+	if (fd < 0) {
+		printf("FAILED TO CREATE/OPEN FILE FOR WRITING\n");
+		if (errno == EACCES ) {
+			perror("DO NOT HAVE ACCESS TO FILE\n");
+		}
+		else if (errno == EADDRINUSE ){
+			perror("FILE ALREADY IN USE\n");
+		}
+		else if (errno == EBADF) {
+			perror("BAD FILE DESCRIPTOR\n");	
+		}
+		else if (errno == EEXIST) {
+			perror("FILE EXISTS\n");
+		}
+		return false;
+	}
+
+	unsigned char header[3 * sizeof(unsigned int) + MATRIX_NAME_LEN];
+	off_t offset = pack_matrix_header(header, m->name, m->rows, m->cols);
+	unsigned int crc = crc32c(0, header, offset);
+	bool ok = write_fully(fd, header, offset, 0);
+
+	/*
+	 * Rows are gathered into a chunk that is checksummed and written
+	 * while still in cache; a dense matrix is its own chunk.
+	 */
+	const size_t row_bytes = (size_t) m->cols * sizeof(unsigned int);
+	const size_t chunk_bytes = STREAM_CHUNK_ELEMENTS * sizeof(unsigned int);
+	const bool dense = is_dense(m);
+	unsigned char* chunk = dense || row_bytes >= chunk_bytes ? NULL : malloc(chunk_bytes);
+	size_t filled = 0;
+	for (unsigned int i = 0; ok && m->data && i < m->rows; ++i) {
+		const unsigned char* row = (const unsigned char*) (m->data + (size_t) i * m->stride);
+		size_t bytes = dense ? row_bytes * m->rows : row_bytes;
+		if (chunk) {
+			memcpy(chunk + filled, row, bytes);
+			filled += bytes;
+			if (filled + row_bytes <= chunk_bytes && i + 1 < m->rows) {
+				continue;
+			}
+			row = chunk;
+			bytes = filled;
+			filled = 0;
+		}
+		for (size_t done = 0; ok && done < bytes; done += chunk_bytes) {
+			const size_t n = bytes - done < chunk_bytes ? bytes - done : chunk_bytes;
+			crc = crc32c(crc, row + done, n);
+			ok = write_fully(fd, row + done, n, offset);
+			offset += n;
+		}
+		if (dense) {
+			break;
+		}
+	}
+	free(chunk);
+
+	/* generated values are made a chunk at a time and never held whole */
+	if (ok && !m->data) {
+		const size_t elements = (size_t) m->rows * m->cols;
+		unsigned int* values = malloc(chunk_bytes);
+		ok = values != NULL;
+		for (size_t first = 0; ok && first < elements; first += STREAM_CHUNK_ELEMENTS) {
+			const size_t n = elements - first < STREAM_CHUNK_ELEMENTS ? elements - first : STREAM_CHUNK_ELEMENTS;
+			generate_matrix_values(m, first, n, values);
+			crc = crc32c(crc, values, n * sizeof(unsigned int));
+			ok = write_fully(fd, values, n * sizeof(unsigned int), offset);
+			offset += n * sizeof(unsigned int);
+		}
+		free(values);
+	}
+	if (!ok || !write_matrix_trailer(fd, offset, crc)) {
+		printf("FAILED TO WRITE MATRIX TO FILE\n");
+		if (errno == EACCES ) {
+			perror("DO NOT HAVE ACCESS TO FILE\n");
+		}
+		else if (errno == ENOSPC) {
+			perror("NO SPACE LEFT ON DEVICE\n");
+		}
+		close(fd);
+		return false;
+	}
+	
+	if (close(fd)) {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * One step of the streaming pipeline for the I/O thread: store the
+ * finished results of the previous chunk and load the operands of the
+ * next one while the calling thread computes the current chunk. Chunks
+ * move in file order, so the checksums follow along.
+ */
+typedef struct {
+	Matrix_File_t* a;
+	Matrix_File_t* b;
+	int out_fd;
+	off_t out_offset;
+	unsigned int out_crc;
+	const unsigned int* write_buffer;
+	size_t write_count;
+	size_t write_first;
+	unsigned int* read_a;
+	unsigned int* read_b;
+	size_t read_count;
+	size_t read_first;
+	bool ok;
+} Stream_Io_t;
+
+/*
+ * PURPOSE: runs one step of the pipeline, see Stream_Io_t
+ * INPUTS:
+ *	arg the Stream_Io_t to run
+ * RETURN:
+ *	NULL, the outcome is left in ok
+ **/
+static void* stream_io (void* arg) {
+	TRACE_SCOPE("stream_io", "io");
+	Stream_Io_t* io = arg;
+	io->ok = true;
+	if (io->write_count > 0) {
+		const size_t bytes = io->write_count * sizeof(unsigned int);
+		io->out_crc = crc32c(io->out_crc, io->write_buffer, bytes);
+		io->ok = write_fully(io->out_fd, io->write_buffer, bytes,
+				io->out_offset + io->write_first * sizeof(unsigned int));
+	}
+	if (io->ok && io->read_count > 0) {
+		io->ok = read_matrix_values(io->a, io->read_a, io->read_count, io->read_first);
+		if (io->ok && io->b) {
+			io->ok = read_matrix_values(io->b, io->read_b, io->read_count, io->read_first);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * PURPOSE: writes the header of a streamed result and pushes every chunk
+ *	of the operands through the pipeline described at stream_matrix_files
+ * INPUTS:
+ *	op the operation
+ *	a the first operand file
+ *	b the second operand file, NULL for unary and scalar operations
+ *	scalar the scalar operand
+ *	out_fd the empty result file
+ *	name the name stored in the result file
+ * RETURN:
+ *	true if the whole result was written
+ **/
+static bool stream_chunks (Matrix_Op_t op, Matrix_File_t* a, Matrix_File_t* b,
+			unsigned int scalar, int out_fd, const char* name) {
+
+	unsigned char header[3 * sizeof(unsigned int) + MATRIX_NAME_LEN];
+	const off_t out_offset = pack_matrix_header(header, name, a->rows, a->cols);
+	if (!write_fully(out_fd, header, out_offset, 0)) {
+		return false;
+	}
+
+	const size_t total = (size_t) a->rows * a->cols;
+	const size_t chunks = (total + STREAM_CHUNK_ELEMENTS - 1) / STREAM_CHUNK_ELEMENTS;
+	unsigned int* buffers = NULL;
+	if (posix_memalign((void**) &buffers, 64, (size_t) STREAM_SLOTS * 2
+			* STREAM_CHUNK_ELEMENTS * sizeof(unsigned int))) {
+		printf("Not enough memory to stream matrices\n");
+		return false;
+	}
+
+	/*slot s holds the first operand at buffers + 2 * s * CHUNK and the second right after it*/
+	Stream_Io_t io = { a, b, out_fd, out_offset, crc32c(0, header, out_offset), NULL, 0, 0,
+			buffers, buffers + STREAM_CHUNK_ELEMENTS,
+			total < STREAM_CHUNK_ELEMENTS ? total : STREAM_CHUNK_ELEMENTS, 0, true };
+	stream_io(&io);
+	for (size_t k = 0; io.ok && k < chunks; ++k) {
+		const size_t first = k * STREAM_CHUNK_ELEMENTS;
+		const size_t count = total - first < STREAM_CHUNK_ELEMENTS ? total - first : STREAM_CHUNK_ELEMENTS;
+		unsigned int* current = buffers + 2 * (k % STREAM_SLOTS) * STREAM_CHUNK_ELEMENTS;
+
+		/*previous chunk out and next chunk in while this one is computed*/
+		io.write_buffer = buffers + 2 * ((k + STREAM_SLOTS - 1) % STREAM_SLOTS) * STREAM_CHUNK_ELEMENTS;
+		io.write_count = k > 0 ? STREAM_CHUNK_ELEMENTS : 0;
+		io.write_first = k > 0 ? first - STREAM_CHUNK_ELEMENTS : 0;
+		io.read_first = first + count;
+		io.read_count = total - io.read_first < STREAM_CHUNK_ELEMENTS ? total - io.read_first : STREAM_CHUNK_ELEMENTS;
+		io.read_a = buffers + 2 * ((k + 1) % STREAM_SLOTS) * STREAM_CHUNK_ELEMENTS;
+		io.read_b = io.read_a + STREAM_CHUNK_ELEMENTS;
+		pthread_t id;
+		const bool started = pthread_create(&id, NULL, stream_io, &io) == 0;
+
+		{
+			TRACE_SCOPE("stream_chunk", "compute");
+			apply_row_operation(op, current, b ? current + STREAM_CHUNK_ELEMENTS : NULL, scalar, current, count);
+		}
+
+		if (started) {
+			pthread_join(id, NULL);
+		}
+		else {
+			stream_io(&io);
+		}
+		if (io.ok && k + 1 == chunks) {
+			io.out_crc = crc32c(io.out_crc, current, count * sizeof(unsigned int));
+			io.ok = write_fully(out_fd, current, count * sizeof(unsigned int),
+					out_offset + first * sizeof(unsigned int));
+		}
+	}
+	free(buffers);
+
+	return io.ok && write_matrix_trailer(out_fd, out_offset + total * sizeof(unsigned int), io.out_crc);
+}
+
+/*
+ * PURPOSE: tells if an open file is the same file as another open file
+ * INPUTS:
+ *	fd the first file
+ *	other the second file
  * RETURN:
- *  If no errors occurred during instantiation then true
- *  else false for an error in the process.
- *
+ *	true if both descriptors refer to one file
  **/
+static bool same_file (int fd, int other) {
+	struct stat st, other_st;
+	return !fstat(fd, &st) && !fstat(other, &other_st)
+		&& st.st_dev == other_st.st_dev && st.st_ino == other_st.st_ino;
+}
 
-bool create_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
-						const unsigned int cols) {
+	// FUNCTION COMMENT
+/***
+* Purpose: Applies an operation to matrix files and writes the result
+*		   to another matrix file without loading whole matrices. Values
+*		   flow through STREAM_SLOTS chunk buffers: while one chunk is
+*		   computed a helper thread writes the previous chunk and reads
+*		   the next one.
+* Input: The operation,
+*		 the file of the first operand,
+*		 the file of the second operand, NULL for unary and scalar operations,
+*		 the scalar operand,
+*		 the file the result is written to, the matrix is named after it
+* Return: True/False
+***/
+bool stream_matrix_files (Matrix_Op_t op, const char* a_filename, const char* b_filename,
+			unsigned int scalar, const char* out_filename) {
+	TRACE_SCOPE("stream_matrix_files", "io");
 
 	// ERROR CHECK INCOMING PARAMETERS
-	if((*new_matrix) != NULL){
-		printf("Matrix already exists\n");
+	if (op >= MATRIX_OP_COUNT || !a_filename || !out_filename) {
+		printf("Invalid streaming operation\n");
 		return false;
 	}
-	if(name == NULL || strcmp(name, "\n") == 0){
-		printf("There's no name for the matrix!\n");
+
+	Matrix_File_t a, b;
+	if (!open_matrix_file(a_filename, &a)) {
+		printf("%s is not a readable matrix file\n", a_filename);
 		return false;
 	}
-	if(rows < 0 || rows > 4294967295){
-		printf("Number of rows outside of valid range\n");
-		return false;	
-	}
-	if(cols < 0 || cols > 4294967295){
-		printf("Number of cols outside of valid range\n");
+	if (b_filename && !open_matrix_file(b_filename, &b)) {
+		printf("%s is not a readable matrix file\n", b_filename);
+		close(a.fd);
 		return false;
 	}
-	
-	*new_matrix = calloc(1,sizeof(Matrix_t));
-	if (!(*new_matrix)) {
+	if (b_filename && (a.rows != b.rows || a.cols != b.cols)) {
+		printf("Matrices in %s and %s have different dimensions\n", a_filename, b_filename);
+		close(a.fd);
+		close(b.fd);
 		return false;
 	}
-	(*new_matrix)->data = calloc(rows * cols,sizeof(unsigned int));
-	if (!(*new_matrix)->data) {
-		return false;
+
+	/*opened without O_TRUNC so an operand that is also the output survives*/
+	int out_fd = open(out_filename, O_CREAT | O_RDWR, 0644);
+	bool ok = out_fd >= 0;
+	if (!ok) {
+		perror(out_filename);
 	}
-	(*new_matrix)->rows = rows;
-	(*new_matrix)->cols = cols;
-	unsigned int len = strlen(name) + 1; 
-	if (len > MATRIX_NAME_LEN) {
-		return false;
+	else if (same_file(out_fd, a.fd) || (b_filename && same_file(out_fd, b.fd))) {
+		printf("Output file %s is also an input\n", out_filename);
+		ok = false;
 	}
-	strncpy((*new_matrix)->name,name,len);
-	return true;
+	else {
+		const char* base = strrchr(out_filename, '/');
+		char name[MATRIX_NAME_LEN] = {0};
+		strncpy(name, base ? base + 1 : out_filename, sizeof(name) - 1);
+		ok = !ftruncate(out_fd, 0) && stream_chunks(op, &a, b_filename ? &b : NULL, scalar, out_fd, name);
+		if (!ok) {
+			printf("FAILED TO WRITE MATRIX TO FILE\n");
+		}
+		else if (!matrix_file_intact(&a) || (b_filename && !matrix_file_intact(&b))) {
+			printf("CHECKSUM MISMATCH IN %s\n", matrix_file_intact(&a) ? b_filename : a_filename);
+			ok = false;
+		}
+		/*never leave a partial or poisoned result behind*/
+		if (!ok) {
+			unlink(out_filename);
+		}
+	}
+
+	if (out_fd >= 0 && close(out_fd)) {
+		ok = false;
+	}
+	close(a.fd);
+	if (b_filename) {
+		close(b.fd);
+	}
+	return ok;
+}
 
+typedef enum {
+	FILE_CHECK_OK,
+	FILE_CHECK_NO_CHECKSUM,
+	FILE_CHECK_MISMATCH,
+	FILE_CHECK_UNREADABLE
+} File_Check_t;
+
+typedef struct {
+	char** filenames;
+	File_Check_t* results;
+} Verify_Job_t;
+
+/*
+ * PURPOSE: checks a share of the files of a verify job, each thread
+ *	with its own chunk buffer
+ * INPUTS:
+ *	context the Verify_Job_t
+ *	begin the first file to check
+ *	end one past the last file to check
+ * RETURN:
+ *	void
+ **/
+static void verify_files_task (void* context, unsigned int begin, unsigned int end) {
+	Verify_Job_t* job = context;
+	unsigned int* buffer = malloc(STREAM_CHUNK_ELEMENTS * sizeof(unsigned int));
+	for (unsigned int i = begin; i < end; ++i) {
+		Matrix_File_t file;
+		if (!buffer || !open_matrix_file(job->filenames[i], &file)) {
+			job->results[i] = FILE_CHECK_UNREADABLE;
+			continue;
+		}
+		const size_t total = (size_t) file.rows * file.cols;
+		bool ok = true;
+		for (size_t first = 0; ok && first < total; first += STREAM_CHUNK_ELEMENTS) {
+			ok = read_matrix_values(&file, buffer,
+					total - first < STREAM_CHUNK_ELEMENTS ? total - first : STREAM_CHUNK_ELEMENTS, first);
+		}
+		close(file.fd);
+		job->results[i] = !ok ? FILE_CHECK_UNREADABLE
+				: !file.has_checksum ? FILE_CHECK_NO_CHECKSUM
+				: matrix_file_intact(&file) ? FILE_CHECK_OK : FILE_CHECK_MISMATCH;
+	}
+	free(buffer);
 }
 
 	// FUNCTION COMMENT
 /***
-* Purpose: Destroys the matrix and frees the memory at that location
-* Input: A matrix
-* Return: void
+* Purpose: Checks matrix files against their stored checksums without
+*		   loading them, spreading the files over the CPUs
+* Input: The files to check,
+*		 how many files there are
+* Return: True if every file is readable and carries a matching checksum
 ***/
-void destroy_matrix (Matrix_t** m) {
+bool verify_matrix_files (char** filenames, unsigned int count) {
+	TRACE_SCOPE("verify_matrix_files", "io");
 
 	// ERROR CHECK INCOMING PARAMETERS
-		if(*m == NULL){
-		printf("matrix does not exist\n");
-		return;
+	if (!filenames || count == 0) {
+		printf("No files to verify\n");
+		return false;
 	}
-	
-	free((*m)->data);
-	free(*m);
-	*m = NULL;
-}
 
+	File_Check_t* results = calloc(count, sizeof(File_Check_t));
+	if (!results) {
+		printf("Not enough memory to verify files\n");
+		return false;
+	}
+	size_t elements = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		struct stat st;
+		if (!stat(filenames[i], &st)) {
+			elements += st.st_size / sizeof(unsigned int);
+		}
+	}
+	Verify_Job_t job = { filenames, results };
+	run_parallel(verify_files_task, &job, count, elements);
+
+	bool ok = true;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (results[i] == FILE_CHECK_OK) {
+			printf("%s: checksum OK\n", filenames[i]);
+		}
+		else if (results[i] == FILE_CHECK_NO_CHECKSUM) {
+			printf("%s: NO CHECKSUM\n", filenames[i]);
+			ok = false;
+		}
+		else if (results[i] == FILE_CHECK_MISMATCH) {
+			printf("%s: CHECKSUM MISMATCH\n", filenames[i]);
+			ok = false;
+		}
+		else {
+			printf("%s: not a readable matrix file\n", filenames[i]);
+			ok = false;
+		}
+	}
+	free(results);
+	return ok;
+}
 
-	
 	// FUNCTION COMMENT
 /***
-* Purpose: Check if the two given matrices are equal
-* Input: 2 seperate matrices 
+* Purpose: Fills a matrix with random values based upon a given range
+* Input: An empty matrix,
+*		 start point of range,
+*		 end point of range
 * Return: True/False
 ***/
-bool equal_matrices (Matrix_t* a, Matrix_t* b) {
-
+bool random_matrix(Matrix_t* m, unsigned int start_range, unsigned int end_range) {
+	TRACE_SCOPE("random_matrix", "compute");
+	
 	// ERROR CHECK INCOMING PARAMETERS
-	if(a == NULL){
-		printf("First matrix is null\n");
+	if(!m)	{
+		printf("No matrix found\n");
 		return false;
 	}
-	if(!a->data){
-		printf("First matrix does not have any data\n");
+	if(!has_values(m)){
+		printf("Not enough space in matrix\n");
 		return false;
 	}
-	if(b == NULL){
-		printf("Second matrix is null\n");
+	if(start_range < 0 || start_range > 4294967295){
+		printf("Start range is invalid\n");
 		return false;
 	}
-	if(!b->data){
-		printf("Second matrix does not have any data\n");
+	if(end_range < 0 || end_range > 4294967295){
+		printf("End range is invalid\n");
 		return false;
 	}
-	if (!a || !b || !a->data || !b->data) {
-		return false;	
+	if (!materialize_matrix(m)) {
+		return false;
+	}
+	
+	for (unsigned int i = 0; i < m->rows; ++i) {
+		for (unsigned int j = 0; j < m->cols; ++j) {
+			m->data[(size_t) i * m->stride + j] = rand() % end_range + start_range;
+		}
 	}
+	touch_matrix(m);
+	return true;
+}
 
-	int result = memcmp(a->data,b->data, sizeof(unsigned int) * a->rows * a->cols);
-	if (result == 0) {
-		return true;
+/*
+ * PURPOSE: copies the data of a spilled matrix from its scratch file into
+ *	another file without bringing the whole matrix back into memory
+ * INPUTS:
+ *	m the spilled matrix
+ *	fd the file to copy into
+ *	offset where in that file the data goes
+ * RETURN:
+ *	true if all the data was copied
+ **/
+static bool copy_spill_file (const Matrix_t* m, int fd, off_t offset) {
+	int in = open(m->spill_path, O_RDONLY);
+	if (in < 0) {
+		perror(m->spill_path);
+		return false;
+	}
+	unsigned char* chunk = malloc(SPILL_COPY_CHUNK);
+	bool ok = chunk != NULL;
+	const size_t bytes = (size_t) m->rows * m->cols * sizeof(unsigned int);
+	size_t done = 0;
+	while (ok && done < bytes) {
+		const size_t want = bytes - done < SPILL_COPY_CHUNK ? bytes - done : SPILL_COPY_CHUNK;
+		ssize_t got = pread(in, chunk, want, done);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		ok = got > 0 && write_fully(fd, chunk, got, offset + done);
+		done += got > 0 ? got : 0;
 	}
-	return false;
+	free(chunk);
+	close(in);
+	return ok;
 }
 
 	// FUNCTION COMMENT
 /***
-* Purpose: Copy a matrix into a different empty matrix
-* Input: The source matrix and an empty matrix
+* Purpose: Writes every matrix in the list into one archive. The archive
+*		   holds a header, an index with the name, dimensions and offset of
+*		   each matrix and then the matrix data aligned to WORKSPACE_ALIGN.
+*		   The archive only replaces the file once it is complete
+* Input: The desired filepath,
+*		 the list of matrices,
+*		 the number of matrices in the list
 * Return: True/False
 ***/
-bool duplicate_matrix (Matrix_t* src, Matrix_t* dest) {
-
+bool save_workspace (const char* workspace_output_filename, Matrix_t** mats, unsigned int num_mats) {
+	TRACE_SCOPE("save_workspace", "io");
 
 	// ERROR CHECK INCOMING PARAMETERS
-	if (!src){
-		printf("Source matrix does not exist\n");
+	if (!workspace_output_filename) {
+		printf("No workspace file given\n");
 		return false;
 	}
-	if (!dest){
-		printf("Destination matrix does not exist\n");
+	if (!mats) {
+		printf("No list found\n");
 		return false;
 	}
-	if (!src->data){
-		printf("The source matrix does not have any data\n");
+
+	/* the list of matrices and the overflow list, spilled and generated matrices included */
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < num_mats; ++i) {
+		if (mats[i] && (has_values(mats[i]) || mats[i]->spill_path)) {
+			++count;
+		}
+	}
+	for (Matrix_t* m = overflow; m; m = m->overflow_next) {
+		if (has_values(m) || m->spill_path) {
+			++count;
+		}
+	}
+	Matrix_t** saved = calloc(count ? count : 1, sizeof(Matrix_t*));
+	if (!saved) {
+		printf("FAILED TO ALLOCATE WORKSPACE INDEX\n");
 		return false;
 	}
-	if (!dest->data){
-		printf("Destination matrix does not have a place for the data\n");
+	unsigned int e = 0;
+	for (unsigned int i = 0; i < num_mats; ++i) {
+		if (mats[i] && (has_values(mats[i]) || mats[i]->spill_path)) {
+			saved[e++] = mats[i];
+		}
+	}
+	for (Matrix_t* m = overflow; m; m = m->overflow_next) {
+		if (has_values(m) || m->spill_path) {
+			saved[e++] = m;
+		}
+	}
+
+	/* header and index are built in memory, payload offsets follow the index */
+	const size_t index_bytes = sizeof(Workspace_Header_t) + count * sizeof(Workspace_Entry_t);
+	unsigned char* index_buffer = calloc(1,index_bytes);
+	if (!index_buffer) {
+		printf("FAILED TO ALLOCATE WORKSPACE INDEX\n");
+		free(saved);
 		return false;
 	}
-	/*
-	 * copy over data
-	 */
-	unsigned int bytesToCopy = sizeof(unsigned int) * src->rows * src->cols;
-	memcpy(dest->data,src->data, bytesToCopy);	
-	return equal_matrices (src,dest);
+	Workspace_Header_t* header = (Workspace_Header_t*) index_buffer;
+	Workspace_Entry_t* entries = (Workspace_Entry_t*) (header + 1);
+	memcpy(header->magic, WORKSPACE_MAGIC, sizeof(header->magic));
+	header->count = count;
+
+	unsigned long long offset = index_bytes;
+	for (e = 0; e < count; ++e) {
+		strncpy(entries[e].name, saved[e]->name, sizeof(entries[e].name) - 1);
+		entries[e].rows = saved[e]->rows;
+		entries[e].cols = saved[e]->cols;
+		entries[e].generator = saved[e]->generator;
+		entries[e].gen_param = saved[e]->gen_param;
+		if (saved[e]->generator != MATRIX_GEN_NONE) {
+			continue;
+		}
+		offset = (offset + WORKSPACE_ALIGN - 1) & ~((unsigned long long) WORKSPACE_ALIGN - 1);
+		entries[e].offset = offset;
+		offset += (unsigned long long) saved[e]->rows * saved[e]->cols * sizeof(unsigned int);
+	}
+
+	/* written beside the target and renamed over it, as loaded matrices may be mappings of the target */
+	char* temp_filename = malloc(strlen(workspace_output_filename) + sizeof(".XXXXXX"));
+	int fd = -1;
+	if (temp_filename) {
+		sprintf(temp_filename, "%s.XXXXXX", workspace_output_filename);
+		fd = mkstemp(temp_filename);
+	}
+	if (fd < 0 || fchmod(fd, 0644)) {
+		printf("FAILED TO CREATE/OPEN WORKSPACE FOR WRITING\n");
+		perror(workspace_output_filename);
+		if (fd >= 0) {
+			close(fd);
+			unlink(temp_filename);
+		}
+		free(temp_filename);
+		free(index_buffer);
+		free(saved);
+		return false;
+	}
+
+	bool ok = write_fully(fd, index_buffer, index_bytes, 0);
+	for (e = 0; ok && e < count; ++e) {
+		const Matrix_t* m = saved[e];
+		const size_t row_bytes = (size_t) m->cols * sizeof(unsigned int);
+		if (m->generator != MATRIX_GEN_NONE) {
+			/* generated matrices are saved as their rule */
+			continue;
+		}
+		if (!m->data) {
+			ok = copy_spill_file(m, fd, entries[e].offset);
+		}
+		else if (is_dense(m)) {
+			ok = write_fully(fd, m->data, row_bytes * m->rows, entries[e].offset);
+		}
+		for (unsigned int r = 0; ok && m->data && !is_dense(m) && r < m->rows; ++r) {
+			ok = write_fully(fd, m->data + (size_t) r * m->stride, row_bytes,
+					entries[e].offset + r * row_bytes);
+		}
+	}
+	ok = ok && fsync(fd) == 0;
+	ok = close(fd) == 0 && ok;
+	ok = ok && rename(temp_filename, workspace_output_filename) == 0;
+	if (!ok) {
+		printf("FAILED TO WRITE WORKSPACE\n");
+		perror(workspace_output_filename);
+		unlink(temp_filename);
+	}
+	free(temp_filename);
+	free(index_buffer);
+	free(saved);
+	return ok;
+}
+
+/*
+ * PURPOSE: makes a matrix whose values are a private mapping of a
+ *	workspace payload. Writes go to copies of the touched pages only
+ *	and never reach the file
+ * INPUTS:
+ *	new_matrix where the new matrix is returned, must point to NULL
+ *	name the name of the matrix
+ *	rows cols the size of the matrix
+ *	fd the workspace file
+ *	offset where the payload starts in the file
+ * RETURN:
+ *	true if the matrix was made
+ **/
+static bool map_workspace_matrix (Matrix_t** new_matrix, const char* name, unsigned int rows,
+			unsigned int cols, int fd, unsigned long long offset) {
+	if (strlen(name) + 1 > MATRIX_NAME_LEN) {
+		printf("Matrix name %s is longer than %d characters\n", name, MATRIX_NAME_LEN - 1);
+		return false;
+	}
+	const unsigned long long page = sysconf(_SC_PAGESIZE);
+	const unsigned long long start = offset & ~(page - 1);
+	const size_t mapping_bytes = (size_t) rows * cols * sizeof(unsigned int) + (offset - start);
+	void* mapping = mmap(NULL, mapping_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, start);
+	if (mapping == MAP_FAILED) {
+		perror("mmap");
+		return false;
+	}
+	*new_matrix = calloc(1,sizeof(Matrix_t));
+	if (!(*new_matrix)) {
+		munmap(mapping, mapping_bytes);
+		return false;
+	}
+	(*new_matrix)->data = (unsigned int*) ((unsigned char*) mapping + (offset - start));
+	(*new_matrix)->mapping = mapping;
+	(*new_matrix)->mapping_bytes = mapping_bytes;
+	(*new_matrix)->rows = rows;
+	(*new_matrix)->cols = cols;
+	(*new_matrix)->stride = cols;
+	memcpy((*new_matrix)->name,name,strlen(name) + 1);
+	return true;
 }
 
 	// FUNCTION COMMENT
 /***
-* Purpose: Shift a matrix either to the left or right by a set number of positions
-* Input: The matrix to shift,
-*		 a direction to shift,
-*		 how many positions to shift the matrix
+* Purpose: Restores every matrix stored in a workspace archive into the
+*		   list of matrices. The values of each large matrix stay in a
+*		   private mapping of the archive, so nothing is read until it is
+*		   used and a write only copies the pages it touches; small
+*		   matrices are copied into their header
+* Input: The workspace file on the system,
+*		 the list of matrices,
+*		 the number of matrices in the list
 * Return: True/False
 ***/
-bool bitwise_shift_matrix (Matrix_t* a, char direction, unsigned int shift) {
-	
+bool load_workspace (const char* workspace_input_filename, Matrix_t** mats, unsigned int num_mats) {
+	TRACE_SCOPE("load_workspace", "io");
+
 	// ERROR CHECK INCOMING PARAMETERS
-	if (!a) {
-		printf("No matrix found");
+	if (!workspace_input_filename) {
+		printf("No workspace file given\n");
 		return false;
 	}
-	if(!a->data){
-		printf("No data found in matrix\n");
+	if (!mats) {
+		printf("No list found\n");
 		return false;
 	}
-	if(direction != 'l' || direction != 'r'){
-		printf("Invalid shift direction!\n");
+
+	int fd = open(workspace_input_filename,O_RDONLY);
+	if (fd < 0) {
+		printf("FAILED TO OPEN WORKSPACE FOR READING\n");
+		perror(workspace_input_filename);
 		return false;
 	}
-	if(shift < 0 || shift > 4294967295){
-		printf("Invalid range for shift\n");
+	struct stat st;
+	if (fstat(fd,&st) || (size_t) st.st_size < sizeof(Workspace_Header_t)) {
+		printf("WORKSPACE FILE IS TOO SHORT\n");
+		close(fd);
 		return false;
-	}	
+	}
+	const size_t file_bytes = st.st_size;
+	unsigned char* base = mmap(NULL, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (base == MAP_FAILED) {
+		printf("FAILED TO MAP WORKSPACE\n");
+		perror(workspace_input_filename);
+		close(fd);
+		return false;
+	}
+
+	const Workspace_Header_t* header = (const Workspace_Header_t*) base;
+	const bool v1 = memcmp(header->magic, WORKSPACE_MAGIC_V1, sizeof(header->magic)) == 0;
+	const size_t entry_bytes = v1 ? offsetof(Workspace_Entry_t, generator) : sizeof(Workspace_Entry_t);
+	if ((!v1 && memcmp(header->magic, WORKSPACE_MAGIC, sizeof(header->magic)) != 0)
+		|| header->count > (file_bytes - sizeof(Workspace_Header_t)) / entry_bytes) {
+		printf("NOT A WORKSPACE FILE\n");
+		munmap(base, file_bytes);
+		close(fd);
+		return false;
+	}
 
-	if (direction == 'l') {
-		unsigned int i = 0;
-		for (; i < a->rows; ++i) {
-			unsigned int j = 0;
-			for (; j < a->rows; ++j) {
-				a->data[i * a->cols + j] = a->data[i * a->cols + j] << shift;
+	bool ok = true;
+	for (unsigned int e = 0; e < header->count; ++e) {
+		const Workspace_Entry_t* entry =
+			(const Workspace_Entry_t*) (base + sizeof(Workspace_Header_t) + e * entry_bytes);
+		char name[sizeof(entry->name)];
+		memcpy(name, entry->name, sizeof(name));
+		name[sizeof(name) - 1] = '\0';
+
+		Matrix_t* m = NULL;
+		if (!v1 && entry->generator != MATRIX_GEN_NONE) {
+			if (!generate_matrix(&m, name, entry->rows, entry->cols,
+					(Matrix_Gen_t) entry->generator, entry->gen_param)) {
+				printf("Failed to create matrix %s from the workspace\n", name);
+				ok = false;
+				continue;
 			}
 		}
-
-	}
-	else {
-		unsigned int i = 0;
-		for (; i < a->rows; ++i) {
-			unsigned int j = 0;
-			for (; j < a->cols; ++j) {
-				a->data[i * a->cols + j] = a->data[i * a->cols + j] >> shift;
+		else {
+			const unsigned long long bytes =
+				(unsigned long long) entry->rows * entry->cols * sizeof(unsigned int);
+			if (entry->offset > file_bytes || bytes > file_bytes - entry->offset) {
+				printf("Workspace entry %s is truncated\n", name);
+				ok = false;
+				continue;
+			}
+			const bool mapped = (unsigned long long) entry->rows * entry->cols > MATRIX_INLINE_ELEMENTS;
+			if (mapped ? !map_workspace_matrix(&m, name, entry->rows, entry->cols, fd, entry->offset)
+					: !create_matrix(&m, name, entry->rows, entry->cols)) {
+				printf("Failed to create matrix %s from the workspace\n", name);
+				ok = false;
+				continue;
+			}
+			if (!mapped) {
+				memcpy(m->data, base + entry->offset, bytes);
 			}
 		}
+
+		if (add_matrix_to_array(mats, m, num_mats) == (unsigned int) -1) {
+			destroy_matrix(&m);
+			ok = false;
+		}
 	}
-	
-	return true;
+
+	munmap(base, file_bytes);
+	close(fd);
+	return ok;
 }
 
 	// FUNCTION COMMENT
 /***
-* Purpose: Add to seperate matrices together and put the result into a different matrix
-* Input: Two matrices with an equal nubmer of rows and cols,
-		 an empty matrix to put the result of the addition of the first two matrices
+* Purpose: Sets how many bytes of matrix data may stay in memory before
+*		   the least recently used matrices are spilled
+* Input: The budget in bytes, 0 for no limit
+* Return: void
+***/
+void set_memory_budget (unsigned long long budget_bytes) {
+	memory_budget = budget_bytes;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Tells how many bytes of matrix data may stay in memory
+* Input: void
+* Return: The budget in bytes, 0 for no limit
+***/
+unsigned long long get_memory_budget (void) {
+	return memory_budget;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Sets the directory spilled matrix data is written to
+* Input: The scratch directory
 * Return: True/False
 ***/
-bool add_matrices (Matrix_t* a, Matrix_t* b, Matrix_t* c) {
+bool set_scratch_directory (const char* scratch_directory) {
 
 	// ERROR CHECK INCOMING PARAMETERS
-	if(!a){
-		printf("Matrix 'a' doesn't exist\n");
-		return false;
-	}
-	if(!b){
-		printf("Matrix 'b' doesnt't exist\n");
-		return false;
-	}
-	if(!c){
-		printf("Matric 'c' doesn't exist\n");
+	if (!scratch_directory) {
+		printf("No scratch directory given\n");
 		return false;
 	}
-	if(!a->data){
-		printf("No data found in matrix 'a'\n");
+	struct stat st;
+	if (stat(scratch_directory,&st) || !S_ISDIR(st.st_mode)) {
+		printf("Scratch directory %s does not exist\n", scratch_directory);
 		return false;
 	}
-	if(!b->data){
-		printf("No data found in matrix 'b'\n");
-		return false;
-	}	
-	if(!c->data){
-		printf("No room for data in matrix 'c'\n");
+	if (strlen(scratch_directory) + 1 > sizeof(scratch_dir)) {
+		printf("Scratch directory path is too long\n");
 		return false;
 	}
-	
-	if (a->rows != b->rows && a->cols != b->cols) {
-		return false;
+	strncpy(scratch_dir, scratch_directory, sizeof(scratch_dir) - 1);
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Starts a new command. Matrices used from now on are pinned in
+*		   memory and in the list of matrices until the next command
+* Input: void
+* Return: void
+***/
+void begin_matrix_command (void) {
+	pthread_mutex_lock(&registry_lock);
+	if (!pins) {
+		pin_clock = ++lru_clock;
 	}
+	pthread_mutex_unlock(&registry_lock);
+}
 
-	for (int i = 0; i < a->rows; ++i) {
-		for (int j = 0; j < b->cols; ++j) {
-			c->data[i * a->cols +j] = a->data[i * a->cols + j] + b->data[i * a->cols + j];
-		}
+	// FUNCTION COMMENT
+/***
+* Purpose: Starts a command that runs alongside others on this thread.
+*		   Until it is released, the matrices it uses stay pinned, and
+*		   begin_matrix_command no longer moves the pins
+* Input: Storage for the pin, which must live until release_matrix_pins
+* Return: void
+***/
+void hold_matrix_pins (Matrix_Pin_t* pin) {
+	pthread_mutex_lock(&registry_lock);
+	pin->ticket = ++lru_clock;
+	pin->num_used = 0;
+	pin->saturated = false;
+	if (!pins) {
+		pin_clock = -1;
 	}
-	return true;
+	pin->next = pins;
+	pins = pin;
+	thread_pin = pin;
+	pthread_mutex_unlock(&registry_lock);
 }
 
 	// FUNCTION COMMENT
 /***
-* Purpose: Prints a matrix to the screen
-* Input: a matrix to display
+* Purpose: Ends a command started with hold_matrix_pins
+* Input: The pin given to hold_matrix_pins
 * Return: void
 ***/
-void display_matrix (Matrix_t* m) {
-	
-	// ERROR CHECK INCOMING PARAMETERS
-	if (!m){
-		printf("Matrix not found\n");
-		return;
+void release_matrix_pins (Matrix_Pin_t* pin) {
+	pthread_mutex_lock(&registry_lock);
+	for (Matrix_Pin_t** link = &pins; *link; link = &(*link)->next) {
+		if (*link == pin) {
+			*link = pin->next;
+			break;
+		}
 	}
-	if(!m->data){
-		printf("No data found in matrix\n");
-		return;
+	for (unsigned int i = 0; i < pin->num_used; ++i) {
+		--pin->used[i]->pin_count;
 	}
-	printf("\nMatrix Contents (%s):\n", m->name);
-	printf("DIM = (%u,%u)\n", m->rows, m->cols);
-	for (int i = 0; i < m->rows; ++i) {
-		for (int j = 0; j < m->cols; ++j) {
-			printf("%u ", m->data[i * m->cols + j]);
+	pin->num_used = 0;
+	if (thread_pin == pin) {
+		thread_pin = NULL;
+	}
+	pin_clock = pins ? (unsigned long long) -1 : lru_clock;
+	for (const Matrix_Pin_t* p = pins; p; p = p->next) {
+		if (p->saturated) {
+			pin_clock = p->ticket < pin_clock ? p->ticket : pin_clock;
 		}
-		printf("\n");
 	}
-	printf("\n");
+	pthread_mutex_unlock(&registry_lock);
+}
 
+	// FUNCTION COMMENT
+/***
+* Purpose: Locks the list of matrices against other threads, for callers
+*		   that search it. The lock may be taken again by the same thread
+* Input: void
+* Return: void
+***/
+void lock_matrices (void) {
+	pthread_mutex_lock(&registry_lock);
 }
 
 	// FUNCTION COMMENT
 /***
-* Purpose: Read a matrix from a file
-* Inputs: a file on the system,
-*		  an empty matrix
-* Return: True/False
+* Purpose: Unlocks the list of matrices locked by lock_matrices
+* Input: void
+* Return: void
 ***/
-bool read_matrix (const char* matrix_input_filename, Matrix_t** m) {
-	
-	// ERROR CHECK INCOMING PARAMETERS
-	if (!m){
-		printf("Matrix does not exist\n");
-		return false;
+void unlock_matrices (void) {
+	pthread_mutex_unlock(&registry_lock);
+}
+
+/*
+ * PURPOSE: how many bytes a matrix keeps in memory
+ * INPUTS:
+ *	m the matrix
+ * RETURN:
+ *	the bytes of data and cached tables owned by the matrix
+ **/
+static unsigned long long resident_bytes (const Matrix_t* m) {
+	unsigned long long bytes = 0;
+	if (m->data && !m->parent && !has_inline_data(m)) {
+		bytes += (unsigned long long) m->rows * m->cols * sizeof(unsigned int);
 	}
-	if(!(*m)->data){
-		printf("Not enough space in matrix to store data\n");
+	if (m->sat) {
+		bytes += ((unsigned long long) m->rows + 1) * (m->cols + 1) * sizeof(unsigned long long);
+	}
+	return bytes;
+}
+
+/*
+ * PURPOSE: writes the data of a matrix to a scratch file and frees it.
+ *	Views and matrices that views look into keep their data.
+ * INPUTS:
+ *	m the matrix to spill
+ * RETURN:
+ *	true if the data is now on disk
+ **/
+static bool spill_matrix (Matrix_t* m) {
+	TRACE_SCOPE("spill_matrix", "io");
+	free(m->sat);
+	m->sat = NULL;
+	if (!m->data || m->parent || m->views > 0 || has_inline_data(m)) {
 		return false;
 	}
 
-	int fd = open(matrix_input_filename,O_RDONLY);
+	static unsigned long long spill_count = 0;
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/matlab-%d-%llu.spill", scratch_dir, (int) getpid(), ++spill_count);
+	int fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0600);
 	if (fd < 0) {
-		printf("FAILED TO OPEN FOR READING\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");	
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
-		}
+		perror(path);
+		return false;
+	}
+	const size_t bytes = (size_t) m->rows * m->cols * sizeof(unsigned int);
+	if (!write_fully(fd, m->data, bytes, 0) || close(fd)) {
+		printf("Failed to spill matrix %s\n", m->name);
+		unlink(path);
 		return false;
 	}
+	m->spill_path = strdup(path);
+	if (!m->spill_path) {
+		unlink(path);
+		return false;
+	}
+	release_data(m);
+	return true;
+}
 
-	/*read the wrote dimensions and name length*/
-	unsigned int name_len = 0;
-	unsigned int rows = 0;
-	unsigned int cols = 0;
-	
-	if (read(fd,&name_len,sizeof(unsigned int)) != sizeof(unsigned int)) {
-		printf("FAILED TO READING FILE\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");	
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
-		}
+/*
+ * PURPOSE: reads the data of a spilled matrix back into memory
+ * INPUTS:
+ *	m the spilled matrix
+ * RETURN:
+ *	true if the data is in memory again
+ **/
+static bool fault_in_matrix (Matrix_t* m) {
+	TRACE_SCOPE("fault_in_matrix", "io");
+	const size_t bytes = (size_t) m->rows * m->cols * sizeof(unsigned int);
+	unsigned int* data = malloc(bytes ? bytes : 1);
+	if (!data) {
+		printf("Failed to allocate memory for spilled matrix %s\n", m->name);
 		return false;
 	}
-	char name_buffer[50];
-	if (read (fd,name_buffer,sizeof(char) * name_len) != sizeof(char) * name_len) {
-		printf("FAILED TO READ MATRIX NAME\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");	
+	int fd = open(m->spill_path, O_RDONLY);
+	if (fd < 0) {
+		perror(m->spill_path);
+		free(data);
+		return false;
+	}
+	size_t done = 0;
+	while (done < bytes) {
+		ssize_t got = pread(fd, (unsigned char*) data + done, bytes - done, done);
+		if (got < 0 && errno == EINTR) {
+			continue;
 		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
+		if (got <= 0) {
+			printf("Failed to read spilled matrix %s\n", m->name);
+			close(fd);
+			free(data);
+			return false;
 		}
-
-		return false;	
+		done += got;
 	}
+	close(fd);
+	unlink(m->spill_path);
+	free(m->spill_path);
+	m->spill_path = NULL;
+	m->data = data;
+	return true;
+}
 
-	if (read (fd,&rows, sizeof(unsigned int)) != sizeof(unsigned int)) {
-		printf("FAILED TO READ MATRIX ROW SIZE\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");	
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
-		}
+/*
+ * PURPOSE: tells whether a matrix is in use by a running command
+ * INPUTS:
+ *	m the matrix
+ * RETURN:
+ *	true if it must stay in memory and in its slot
+ **/
+static bool matrix_pinned (const Matrix_t* m) {
+	return m->pin_count > 0 || m->last_used > pin_clock;
+}
 
-		return false;
+/*
+ * PURPOSE: records that the held command of this thread uses a matrix
+ * INPUTS:
+ *	m the matrix
+ * RETURN:
+ *	void
+ **/
+static void pin_matrix (Matrix_t* m) {
+	Matrix_Pin_t* p = thread_pin;
+	if (!p) {
+		return;
 	}
-
-	if (read(fd,&cols,sizeof(unsigned int)) != sizeof(unsigned int)) {
-		printf("FAILED TO READ MATRIX COLUMN SIZE\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");	
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
+	for (unsigned int i = 0; i < p->num_used; ++i) {
+		if (p->used[i] == m) {
+			return;
 		}
-
-		return false;
 	}
+	if (p->num_used == MAX_PINNED_MATRICES) {
+		/* too many to list, everything used since the command started stays pinned */
+		p->saturated = true;
+		pin_clock = p->ticket < pin_clock ? p->ticket : pin_clock;
+		return;
+	}
+	p->used[p->num_used++] = m;
+	++m->pin_count;
+}
 
-	unsigned int numberOfDataBytes = rows * cols * sizeof(unsigned int);
-	unsigned int *data = calloc(rows * cols, sizeof(unsigned int));
-	if (read(fd,data,numberOfDataBytes) != numberOfDataBytes) {
-		printf("FAILED TO READ MATRIX DATA\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");	
+/*
+ * PURPOSE: spills least recently used unpinned matrices until the data
+ *	in memory fits the budget or nothing else can be spilled
+ * INPUTS:
+ *	mats the list of matrices
+ *	num_mats the number of matrices in the list
+ * RETURN:
+ *	void
+ **/
+static void enforce_memory_budget (Matrix_t** mats, unsigned int num_mats) {
+	if (memory_budget == 0) {
+		return;
+	}
+	for (;;) {
+		unsigned long long resident = 0;
+		Matrix_t* victim = NULL;
+		for (unsigned int i = 0; i <= num_mats; ++i) {
+			/* the slots of the list first, then the whole overflow list */
+			Matrix_t* m = i < num_mats ? mats[i] : overflow;
+			for (; m; m = i < num_mats ? NULL : m->overflow_next) {
+				resident += resident_bytes(m);
+				if (m->data && !m->parent && m->views == 0 && !has_inline_data(m)
+					&& !matrix_pinned(m)
+					&& (!victim || m->last_used < victim->last_used)) {
+					victim = m;
+				}
+			}
 		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
+		if (resident <= memory_budget || !victim || !spill_matrix(victim)) {
+			return;
 		}
-
-		return false;	
 	}
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Marks a matrix as used by the current command and brings its
+*		   data back into memory if it was spilled
+* Input: The list of matrices,
+*		 the number of matrices in the list,
+*		 the matrix about to be used
+* Return: True if the matrix data is in memory
+***/
+bool use_matrix (Matrix_t** mats, unsigned int num_mats, Matrix_t* m) {
 
-	if (!create_matrix(m,name_buffer,rows,cols)) {
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!m) {
+		printf("No matrix found\n");
 		return false;
 	}
 
-	load_matrix(*m,data);
+	pthread_mutex_lock(&registry_lock);
+	m->last_used = ++lru_clock;
+	pin_matrix(m);
+	if (m->parent) {
+		m->parent->last_used = m->last_used;
+		pin_matrix(m->parent);
+	}
+	bool ok = true;
+	if (!m->data && m->spill_path) {
+		ok = fault_in_matrix(m);
+		if (ok) {
+			enforce_memory_budget(mats, num_mats);
+		}
+	}
+	pthread_mutex_unlock(&registry_lock);
+	return ok;
+}
 
-	if (close(fd)) {
-		return false;
+	// FUNCTION COMMENT
+/***
+* Purpose: Removes a matrix from the overflow list
+* Input: The name of the matrix
+* Return: The matrix, NULL if no matrix of that name overflowed
+***/
+Matrix_t* take_overflow_matrix (const char* name) {
+	if (!name) {
+		return NULL;
+	}
+	Matrix_t* m = NULL;
+	pthread_mutex_lock(&registry_lock);
+	for (Matrix_t** link = &overflow; *link; link = &(*link)->overflow_next) {
+		if (strncmp((*link)->name, name, MATRIX_NAME_LEN) == 0) {
+			m = *link;
+			*link = m->overflow_next;
+			m->overflow_next = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&registry_lock);
+	return m;
+}
 
+	// FUNCTION COMMENT
+/***
+* Purpose: Puts a matrix taken with take_overflow_matrix back on the
+*		   overflow list
+* Input: The matrix
+* Return: void
+***/
+void return_overflow_matrix (Matrix_t* m) {
+	if (!m) {
+		return;
 	}
-	return true;
+	pthread_mutex_lock(&registry_lock);
+	m->overflow_next = overflow;
+	overflow = m;
+	pthread_mutex_unlock(&registry_lock);
 }
 
 	// FUNCTION COMMENT
 /***
-* Purpose: Writes a matrix to a file
-* Input: The desired filepath,
-*		 matrix to write to the file
-* Return: True/False
+* Purpose: Finds the name of the matrix that owns the data of a matrix,
+*		   which is the matrix itself unless it is a view. Nothing is
+*		   marked as used or brought back from the overflow list
+* Input: The list of matrices,
+*		 the number of matrices in the list,
+*		 the matrix name,
+*		 receives the owner name, MATRIX_NAME_LEN bytes
+* Return: True if a matrix of that name exists
 ***/
-bool write_matrix (const char* matrix_output_filename, Matrix_t* m) {
-	
+bool find_matrix_owner (Matrix_t** mats, unsigned int num_mats, const char* name, char* owner) {
+
 	// ERROR CHECK INCOMING PARAMETERS
-	if (!m){
-		printf("Matrix does not exist\n");
-		return false;
-	}
-	if(!(m)->data){
-		printf("Not enough space in matrix to store data\n");
+	if (!mats || !name || !owner) {
 		return false;
 	}
 
-	int fd = open (matrix_output_filename, O_CREAT | O_RDWR | O_TRUNC, 0644);
-	/* ERROR HANDLING USING errorno*/
-	if (fd < 0) {
-		printf("FAILED TO CREATE/OPEN FILE FOR WRITING\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");	
+	const Matrix_t* found = NULL;
+	pthread_mutex_lock(&registry_lock);
+	for (unsigned int i = 0; i < num_mats && !found; ++i) {
+		if (mats[i] && strncmp(mats[i]->name, name, MATRIX_NAME_LEN) == 0) {
+			found = mats[i];
 		}
-		else if (errno == EEXIST) {
-			perror("FILE EXISTS\n");
-		}
-		return false;
 	}
-	/* Calculate the needed buffer for our matrix */
-	unsigned int name_len = strlen(m->name) + 1;
-	unsigned int numberOfBytes = sizeof(unsigned int) + (sizeof(unsigned int)  * 2) + name_len + sizeof(unsigned int) * m->rows * m->cols + 1;
-	/* Allocate the output_buffer in bytes
-	 * IMPORTANT TO UNDERSTAND THIS WAY OF MOVING MEMORY
-	 */
-	unsigned char* output_buffer = calloc(numberOfBytes,sizeof(unsigned char));
-	unsigned int offset = 0;
-	memcpy(&output_buffer[offset], &name_len, sizeof(unsigned int)); // IMPORTANT C FUNCTION TO KNOW
-	offset += sizeof(unsigned int);	
-	memcpy(&output_buffer[offset], m->name,name_len);
-	offset += name_len;
-	memcpy(&output_buffer[offset],&m->rows,sizeof(unsigned int));
-	offset += sizeof(unsigned int);
-	memcpy(&output_buffer[offset],&m->cols,sizeof(unsigned int));
-	offset += sizeof(unsigned int);
-	memcpy (&output_buffer[offset],m->data,m->rows * m->cols * sizeof(unsigned int));
-	offset += (m->rows * m->cols * sizeof(unsigned int));
-	output_buffer[numberOfBytes - 1] = EOF;
-
-	if (write(fd,output_buffer,numberOfBytes) != numberOfBytes) {
-		printf("FAILED TO WRITE MATRIX TO FILE\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");	
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
+	for (const Matrix_t* m = overflow; m && !found; m = m->overflow_next) {
+		if (strncmp(m->name, name, MATRIX_NAME_LEN) == 0) {
+			found = m;
 		}
-		return false;
 	}
-	
-	if (close(fd)) {
-		return false;
+	if (found) {
+		const Matrix_t* root = found->parent ? found->parent : found;
+		memcpy(owner, root->name, MATRIX_NAME_LEN);
 	}
-	free(output_buffer);
-
-	return true;
+	pthread_mutex_unlock(&registry_lock);
+	return found != NULL;
 }
 
 	// FUNCTION COMMENT
 /***
-* Purpose: Fills a matrix with random values based upon a given range
-* Input: An empty matrix,
-*		 start point of range,
-*		 end point of range
-* Return: True/False
+* Purpose: Destroys every matrix on the overflow list
+* Input: void
+* Return: void
 ***/
-bool random_matrix(Matrix_t* m, unsigned int start_range, unsigned int end_range) {
-	
-	// ERROR CHECK INCOMING PARAMETERS
-	if(!m)	{
-		printf("No matrix found\n");
-		return false;
-	}
-	if(!m->data){
-		printf("Not enough space in matrix\n");
-		return false;
-	}
-	if(start_range < 0 || start_range > 4294967295){
-		printf("Start range is invalid\n");
-		return false;
-	}
-	if(end_range < 0 || end_range > 4294967295){
-		printf("End range is invalid\n");
-		return false;
-	}
-	
-	for (unsigned int i = 0; i < m->rows; ++i) {
-		for (unsigned int j = 0; j < m->cols; ++j) {
-			m->data[i * m->cols + j] = rand() % end_range + start_range;
-		}
+void destroy_overflow_matrices (void) {
+	while (overflow) {
+		Matrix_t* m = overflow;
+		overflow = m->overflow_next;
+		destroy_matrix(&m);
 	}
-	return true;
 }
 
 /*Protected Functions in C*/
@@ -569,7 +4071,7 @@ void load_matrix (Matrix_t* m, unsigned int* data) {
 		printf("Matrix not found\n");
 		return;
 	}
-	if(!m->data){
+	if(!has_values(m)){
 		printf("Not enough space in matrix\n");
 		return;
 	}
@@ -577,14 +4079,83 @@ void load_matrix (Matrix_t* m, unsigned int* data) {
 		printf("No data found\n");
 		return;
 	}
+	if (!materialize_matrix(m)) {
+		return;
+	}
 	
 	memcpy(m->data,data,m->rows * m->cols * sizeof(unsigned int));
+	touch_matrix(m);
+}
+
+/*
+ * PURPOSE: puts a matrix into the list of matrices, called with the
+ *	registry lock held
+ * INPUTS:
+ *	mats the list of matrices
+ *	new_matrix the matrix to add
+ *	num_mats the number of matrices in the list
+ * RETURN:
+ *	the position of the new matrix in the list
+ **/
+static unsigned int insert_matrix (Matrix_t** mats, Matrix_t* new_matrix, unsigned int num_mats) {
+	new_matrix->last_used = ++lru_clock;
+	pin_matrix(new_matrix);
+	unsigned int pos = num_mats;
+	for (unsigned int i = 0; i < num_mats && pos == num_mats; ++i) {
+		if (mats[i] && strncmp(mats[i]->name, new_matrix->name, MATRIX_NAME_LEN) == 0) {
+			pos = i;
+		}
+	}
+	for (unsigned int i = 0; i < num_mats && pos == num_mats; ++i) {
+		if (!mats[i]) {
+			pos = i;
+		}
+	}
+
+	/* full, the least recently used unpinned matrix moves to the overflow list */
+	const bool full = pos == num_mats;
+	if (full) {
+		pos = 0;
+		for (unsigned int i = 1; i < num_mats; ++i) {
+			const bool pinned = matrix_pinned(mats[i]);
+			const bool pos_pinned = matrix_pinned(mats[pos]);
+			if ((pos_pinned && !pinned) || (pinned == pos_pinned && mats[i]->last_used < mats[pos]->last_used)) {
+				pos = i;
+			}
+		}
+		/* while commands run side by side another thread may still use a pinned slot */
+		if (pins && matrix_pinned(mats[pos])) {
+			printf("Every matrix is in use, no room for %s\n", new_matrix->name);
+			return -1;
+		}
+	}
+
+	/* a matrix of the same name waiting on the overflow list is replaced too */
+	Matrix_t* stale = take_overflow_matrix(new_matrix->name);
+	if (stale && stale != new_matrix) {
+		destroy_matrix(&stale);
+	}
+	if (mats[pos] == new_matrix) {
+		return pos;
+	}
+	if (full) {
+		mats[pos]->overflow_next = overflow;
+		overflow = mats[pos];
+	}
+	else if (mats[pos]) {
+		destroy_matrix(&mats[pos]);
+	}
+	mats[pos] = new_matrix;
+	enforce_memory_budget(mats, num_mats);
+	return pos;
 }
 
 	// FUNCTION COMMENT
 /***
-* Purpose: Add a matrix to the list of matrices. Overwrites old
-*		   matrix if a matrix already exists in the desired location
+* Purpose: Add a matrix to the list of matrices. A matrix with the same
+*		   name is replaced, otherwise the first empty slot is used. When
+*		   the list is full the least recently used matrix moves to the
+*		   overflow list, where find_matrix_given_name can still find it
 * Input: The list of matrices,
 * 		 the new matrix,
 * 		 the number of matrices in the list
@@ -597,7 +4168,7 @@ unsigned int add_matrix_to_array (Matrix_t** mats, Matrix_t* new_matrix, unsigne
 		printf("No list found\n");
 		return -1;
 	}
-	if(num_mats > 10 || num_mats < 0 ){
+	if(num_mats == 0){
 		printf("Invalid number of matrices\n");
 		return -1;
 	}
@@ -605,17 +4176,13 @@ unsigned int add_matrix_to_array (Matrix_t** mats, Matrix_t* new_matrix, unsigne
 		printf("No matrix found");
 		return -1;
 	}
-	if(!new_matrix->data){
+	if(!has_values(new_matrix) && !new_matrix->spill_path){
 		printf("No data found in new matrix\n");
 		return -1;
 	}
 	
-	static long int current_position = 0;
-	const long int pos = current_position % num_mats;
-	if ( mats[pos] ) {
-		destroy_matrix(&mats[pos]);
-	} 
-	mats[pos] = new_matrix;
-	current_position++;
+	pthread_mutex_lock(&registry_lock);
+	const unsigned int pos = insert_matrix(mats, new_matrix, num_mats);
+	pthread_mutex_unlock(&registry_lock);
 	return pos;
 }
@@ -3,25 +3,133 @@
 
 #define MATRIX_NAME_LEN 25
 
-typedef struct {
+/* element-wise operations, the _SCALAR ones combine every value with one scalar */
+typedef enum {
+	MATRIX_OP_ADD,
+	MATRIX_OP_SUB,
+	MATRIX_OP_MUL,
+	MATRIX_OP_AND,
+	MATRIX_OP_OR,
+	MATRIX_OP_XOR,
+	MATRIX_OP_NOT,
+	MATRIX_OP_ADD_SCALAR,
+	MATRIX_OP_MUL_SCALAR,
+	MATRIX_OP_SHL_SCALAR,
+	MATRIX_OP_SHR_SCALAR,
+	MATRIX_OP_COUNT
+} Matrix_Op_t;
+
+/* how reduce_matrix combines the values along a row or a column */
+typedef enum {
+	MATRIX_REDUCE_SUM,
+	MATRIX_REDUCE_MIN,
+	MATRIX_REDUCE_MAX,
+	MATRIX_REDUCE_COUNT
+} Matrix_Reduce_t;
+
+/* how convolve_matrix makes up values outside the matrix */
+typedef enum {
+	MATRIX_BORDER_ZERO,
+	MATRIX_BORDER_CLAMP,
+	MATRIX_BORDER_WRAP
+} Matrix_Border_t;
+
+/* rule that produces the values of a matrix that stores none */
+typedef enum {
+	MATRIX_GEN_NONE,
+	MATRIX_GEN_RANDOM,
+	MATRIX_GEN_IDENTITY,
+	MATRIX_GEN_CONST,
+	MATRIX_GEN_RANGE
+} Matrix_Gen_t;
+
+typedef struct Matrix {
 	char name[MATRIX_NAME_LEN];
 	unsigned int rows;
 	unsigned int cols;
 	unsigned int *data;
+	unsigned int stride;	/* elements from the start of one row to the next */
+	struct Matrix *parent;	/* owner of data when this matrix is a view */
+	unsigned int views;	/* live views into this matrix's data */
+	bool detached;		/* destroyed while views still reference the data */
+	unsigned int version;	/* bumped on the owner whenever the data changes */
+	unsigned int sat_version;	/* owner version the summed-area table was built from */
+	unsigned long long *sat;	/* cached (rows + 1) x (cols + 1) summed-area table */
+	unsigned long long last_used;	/* LRU clock of the last command that used the matrix */
+	char *spill_path;	/* scratch file holding the data while data is NULL */
+	struct Matrix *overflow_next;	/* next matrix evicted from a full list of matrices */
+	Matrix_Gen_t generator;	/* how values are made while data is NULL, until first written */
+	unsigned long long gen_param;	/* seed, constant or first value of the generator */
+	void *mapping;	/* private file mapping holding data, NULL when data was allocated */
+	size_t mapping_bytes;
+	unsigned int pin_count;	/* held commands that used the matrix */
 }Matrix_t;
 
+#define MAX_PINNED_MATRICES 128
+
+/* one command running alongside others, see hold_matrix_pins */
+typedef struct Matrix_Pin {
+	unsigned long long ticket;
+	unsigned int num_used;
+	bool saturated;	/* used more matrices than fit, pins everything used since ticket */
+	Matrix_t *used[MAX_PINNED_MATRICES];	/* the matrices the command used */
+	struct Matrix_Pin *next;
+} Matrix_Pin_t;
+
 bool create_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows, const unsigned int cols);
+bool create_view (Matrix_t** view, const char* name, Matrix_t* parent, unsigned int row_start,
+			unsigned int row_end, unsigned int col_start, unsigned int col_end);
+bool generate_matrix (Matrix_t** new_matrix, const char* name, unsigned int rows, unsigned int cols,
+			Matrix_Gen_t generator, unsigned long long param);
+void generate_matrix_values (const Matrix_t* m, unsigned long long first, size_t count,
+			unsigned int* values);
+bool materialize_matrix (Matrix_t* m);
 void destroy_matrix (Matrix_t** m); 
 bool write_matrix (const char* matrix_output_filename, Matrix_t* m);
+bool stream_matrix_files (Matrix_Op_t op, const char* a_filename, const char* b_filename,
+			unsigned int scalar, const char* out_filename);
+bool verify_matrix_files (char** filenames, unsigned int count);
 bool read_matrix (const char* matrix_input_filename, Matrix_t** m);
+bool read_matrix_name (const char* matrix_input_filename, char* name);
 int sum_matrix (Matrix_t* m);
+bool reduce_matrix (Matrix_t* m, bool per_row, Matrix_Reduce_t reduce, Matrix_t* out);
+bool region_sum_matrix (Matrix_t* m, unsigned int row_start, unsigned int row_end,
+			unsigned int col_start, unsigned int col_end, unsigned long long* sum);
+void touch_matrix (Matrix_t* m);
+bool matrices_overlap (const Matrix_t* dst, const Matrix_t* src);
 bool add_matrices (Matrix_t* a, Matrix_t* b, Matrix_t* c); 
+bool elementwise_matrices (Matrix_Op_t op, Matrix_t* a, Matrix_t* b, Matrix_t* c);
+bool scalar_matrix (Matrix_Op_t op, Matrix_t* a, unsigned int scalar, Matrix_t* c);
+void apply_row_operation (Matrix_Op_t op, const unsigned int* a, const unsigned int* b,
+			unsigned int scalar, unsigned int* c, size_t n);
+bool convolve_matrix (Matrix_t* src, Matrix_t* kernel, Matrix_Border_t border, Matrix_t* dst);
+bool histogram_matrix (Matrix_t* m, unsigned int bins, unsigned long long* counts,
+			unsigned long long* edges);
+bool topk_matrix (Matrix_t* m, unsigned int k, unsigned int* values, unsigned int* rows,
+			unsigned int* cols);
+bool sort_rows_matrix (Matrix_t* m, unsigned int col);
 bool bitwise_shift_matrix (Matrix_t* a, char direction, unsigned int shift);
+bool bitwise_shift_matrix_into (Matrix_t* a, char direction, unsigned int shift, Matrix_t* dest);
 bool duplicate_matrix (Matrix_t* src, Matrix_t* dest);
 bool equal_matrices (Matrix_t* a, Matrix_t* b); 
 void display_matrix (Matrix_t* m); 
 bool random_matrix(Matrix_t* m, unsigned int start_range, unsigned int end_range);
 unsigned int add_matrix_to_array (Matrix_t** mats, Matrix_t* new_matrix, unsigned int num_mats);
+bool save_workspace (const char* workspace_output_filename, Matrix_t** mats, unsigned int num_mats);
+bool load_workspace (const char* workspace_input_filename, Matrix_t** mats, unsigned int num_mats);
+void set_memory_budget (unsigned long long budget_bytes);
+unsigned long long get_memory_budget (void);
+bool set_scratch_directory (const char* scratch_directory);
+void begin_matrix_command (void);
+void hold_matrix_pins (Matrix_Pin_t* pin);
+void release_matrix_pins (Matrix_Pin_t* pin);
+void lock_matrices (void);
+void unlock_matrices (void);
+bool use_matrix (Matrix_t** mats, unsigned int num_mats, Matrix_t* m);
+Matrix_t* take_overflow_matrix (const char* name);
+void return_overflow_matrix (Matrix_t* m);
+bool find_matrix_owner (Matrix_t** mats, unsigned int num_mats, const char* name, char* owner);
+void destroy_overflow_matrices (void);
 
 
 #endif
@@ -0,0 +1,712 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include "command.h"
+#include "matrix.h"
+#include "access.h"
+#include "script.h"
+#include "trace.h"
+
+/*defined in main.c*/
+void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats);
+
+/*
+ * One line of the script. Commands become ready once every command they
+ * depend on has finished; their output is kept until every line before
+ * them has been printed.
+ */
+typedef struct {
+	char* line;
+	Commands_t* cmd;	/* NULL for lines that are only echoed */
+	unsigned int* dependents;
+	unsigned int num_dependents;
+	unsigned int dependents_cap;
+	unsigned int waiting;	/* unfinished commands this one depends on */
+	char* output;
+	size_t output_len;
+	bool done;
+} Script_Command_t;
+
+/* the commands since the last barrier that must finish before a resource changes */
+typedef struct {
+	char name[RESOURCE_LEN];
+	int last_writer;
+	unsigned int* readers;
+	unsigned int num_readers;
+	unsigned int readers_cap;
+} Script_Resource_t;
+
+/* "m:<view>" maps to the matrix owning the data, "f:<file>" to the matrix the file holds */
+typedef struct {
+	char key[RESOURCE_LEN];
+	char value[MATRIX_NAME_LEN];
+} Script_Name_t;
+
+/* owner pushes and pops at the tail, thieves take from the head */
+typedef struct {
+	pthread_mutex_t lock;
+	unsigned int* tasks;
+	unsigned int head;
+	unsigned int tail;
+} Script_Queue_t;
+
+typedef struct {
+	Script_Command_t* commands;
+	unsigned int num_commands;
+	unsigned int commands_cap;
+	Script_Resource_t* resources;
+	unsigned int num_resources;
+	unsigned int resources_cap;
+	Script_Name_t* names;
+	unsigned int num_names;
+	unsigned int names_cap;
+	int last_barrier;
+	unsigned int matrix_writers;
+
+	Matrix_t** registry;
+	unsigned int registry_len;
+	Script_Queue_t queues[MAX_SCRIPT_JOBS];
+	unsigned int jobs;
+	pthread_mutex_t idle_lock;
+	pthread_cond_t idle;
+	unsigned int queued;
+	unsigned int remaining;
+	pthread_mutex_t output_lock;
+	unsigned int next_output;
+	FILE* out;
+} Script_t;
+
+typedef struct {
+	Script_t* script;
+	unsigned int id;
+} Script_Worker_t;
+
+/*
+ * PURPOSE: makes room for one more element in a growing array
+ * INPUTS:
+ *	array the array, which may be moved
+ *	cap its capacity in elements
+ *	len the elements in use
+ *	size the size of one element
+ * RETURN:
+ *	true if array has room for len + 1 elements
+ **/
+static bool reserve (void** array, unsigned int* cap, unsigned int len, size_t size) {
+	if (len < *cap) {
+		return true;
+	}
+	const unsigned int new_cap = *cap ? *cap * 2 : 16;
+	void* grown = realloc(*array, new_cap * size);
+	if (!grown) {
+		printf("Out of memory reading the script\n");
+		return false;
+	}
+	memset((char*) grown + (size_t) *cap * size, 0, (size_t) (new_cap - *cap) * size);
+	*array = grown;
+	*cap = new_cap;
+	return true;
+}
+
+/*
+ * PURPOSE: looks up a name recorded while reading the script
+ * INPUTS:
+ *	s the script
+ *	key "m:<view>" or "f:<file>"
+ * RETURN:
+ *	the recorded value, NULL if there is none
+ **/
+static const char* find_name (const Script_t* s, const char* key) {
+	for (unsigned int i = 0; i < s->num_names; ++i) {
+		if (strcmp(s->names[i].key, key) == 0) {
+			return s->names[i].value;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * PURPOSE: records or replaces a name
+ * INPUTS:
+ *	context the script
+ *	key "m:<view>" or "f:<file>"
+ *	value the matrix name it maps to
+ * RETURN:
+ *	true if the name was recorded
+ **/
+static bool set_name (void* context, const char* key, const char* value) {
+	Script_t* s = context;
+	Script_Name_t* entry = NULL;
+	for (unsigned int i = 0; i < s->num_names && !entry; ++i) {
+		if (strcmp(s->names[i].key, key) == 0) {
+			entry = &s->names[i];
+		}
+	}
+	if (!entry) {
+		if (!reserve((void**) &s->names, &s->names_cap, s->num_names, sizeof(Script_Name_t))) {
+			return false;
+		}
+		entry = &s->names[s->num_names++];
+		snprintf(entry->key, sizeof(entry->key), "%s", key);
+	}
+	snprintf(entry->value, sizeof(entry->value), "%s", value);
+	return true;
+}
+
+/*
+ * PURPOSE: follows views to the matrix that owns their data
+ * INPUTS:
+ *	context the script
+ *	name the matrix name
+ *	root where the owner name goes, MATRIX_NAME_LEN bytes
+ * RETURN:
+ *	void
+ **/
+static void root_matrix_name (void* context, const char* name, char* root) {
+	const Script_t* s = context;
+	char key[RESOURCE_LEN];
+	snprintf(root, MATRIX_NAME_LEN, "%s", name);
+	for (const char* owner = NULL; ; ) {
+		snprintf(key, sizeof(key), "m:%s", root);
+		owner = find_name(s, key);
+		if (!owner) {
+			return;
+		}
+		snprintf(root, MATRIX_NAME_LEN, "%s", owner);
+	}
+}
+
+/*
+ * PURPOSE: the name read gives a matrix file, from the script command that
+ *	wrote it or else from the file as it is now
+ * INPUTS:
+ *	context the script
+ *	file the matrix file
+ *	name where the name goes, MATRIX_NAME_LEN bytes
+ * RETURN:
+ *	true if the name is known
+ **/
+static bool file_matrix_name (void* context, const char* file, char* name) {
+	const Script_t* s = context;
+	char key[RESOURCE_LEN];
+	snprintf(key, sizeof(key), "f:%s", file);
+	const char* written = find_name(s, key);
+	if (written) {
+		snprintf(name, MATRIX_NAME_LEN, "%s", written);
+		return true;
+	}
+	return read_matrix_name(file, name);
+}
+
+/*
+ * PURPOSE: makes one command wait for an earlier one
+ * INPUTS:
+ *	s the script
+ *	before the earlier command
+ *	after the command that waits
+ * RETURN:
+ *	true unless out of memory
+ **/
+static bool add_dependency (Script_t* s, unsigned int before, unsigned int after) {
+	Script_Command_t* c = &s->commands[before];
+	/*dependencies of one command are added together, so a repeat is the last one*/
+	if (before == after || (c->num_dependents && c->dependents[c->num_dependents - 1] == after)) {
+		return true;
+	}
+	if (!reserve((void**) &c->dependents, &c->dependents_cap, c->num_dependents, sizeof(unsigned int))) {
+		return false;
+	}
+	c->dependents[c->num_dependents++] = after;
+	++s->commands[after].waiting;
+	return true;
+}
+
+/*
+ * PURPOSE: finds the state of a resource, adding it if it is new
+ * INPUTS:
+ *	s the script
+ *	name the resource
+ * RETURN:
+ *	the resource, NULL if out of memory
+ **/
+static Script_Resource_t* find_resource (Script_t* s, const char* name) {
+	for (unsigned int i = 0; i < s->num_resources; ++i) {
+		if (strcmp(s->resources[i].name, name) == 0) {
+			return &s->resources[i];
+		}
+	}
+	if (!reserve((void**) &s->resources, &s->resources_cap, s->num_resources, sizeof(Script_Resource_t))) {
+		return NULL;
+	}
+	Script_Resource_t* r = &s->resources[s->num_resources++];
+	snprintf(r->name, sizeof(r->name), "%s", name);
+	r->last_writer = -1;
+	return r;
+}
+
+/*
+ * PURPOSE: adds the edges for one command to the dependency graph. Reads
+ *	wait for the last write, writes wait for the last write and every read
+ *	since, barriers wait for everything since the previous barrier.
+ * INPUTS:
+ *	s the script
+ *	index the command
+ *	a what the command reads and writes
+ * RETURN:
+ *	true unless out of memory
+ **/
+static bool add_command_edges (Script_t* s, unsigned int index, const Command_Access_t* a) {
+	if (s->last_barrier >= 0 && !add_dependency(s, s->last_barrier, index)) {
+		return false;
+	}
+	if (a->barrier) {
+		for (unsigned int i = 0; i < s->num_resources; ++i) {
+			Script_Resource_t* r = &s->resources[i];
+			if (r->last_writer >= 0 && !add_dependency(s, r->last_writer, index)) {
+				return false;
+			}
+			for (unsigned int j = 0; j < r->num_readers; ++j) {
+				if (!add_dependency(s, r->readers[j], index)) {
+					return false;
+				}
+			}
+			r->last_writer = -1;
+			r->num_readers = 0;
+		}
+		s->last_barrier = index;
+		return true;
+	}
+
+	for (unsigned int i = 0; i < a->num_reads; ++i) {
+		Script_Resource_t* r = find_resource(s, a->reads[i]);
+		if (!r || (r->last_writer >= 0 && !add_dependency(s, r->last_writer, index))) {
+			return false;
+		}
+	}
+	for (unsigned int i = 0; i < a->num_writes; ++i) {
+		Script_Resource_t* r = find_resource(s, a->writes[i]);
+		if (!r || (r->last_writer >= 0 && !add_dependency(s, r->last_writer, index))) {
+			return false;
+		}
+		for (unsigned int j = 0; j < r->num_readers; ++j) {
+			if (!add_dependency(s, r->readers[j], index)) {
+				return false;
+			}
+		}
+	}
+	/*record this command only once every edge into it is known*/
+	for (unsigned int i = 0; i < a->num_reads; ++i) {
+		Script_Resource_t* r = find_resource(s, a->reads[i]);
+		if (!reserve((void**) &r->readers, &r->readers_cap, r->num_readers, sizeof(unsigned int))) {
+			return false;
+		}
+		if (!r->num_readers || r->readers[r->num_readers - 1] != index) {
+			r->readers[r->num_readers++] = index;
+		}
+	}
+	for (unsigned int i = 0; i < a->num_writes; ++i) {
+		Script_Resource_t* r = find_resource(s, a->writes[i]);
+		r->last_writer = index;
+		r->num_readers = 0;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: reads the script into commands and builds the dependency graph
+ * INPUTS:
+ *	s the script
+ *	file the open script file
+ * RETURN:
+ *	true if the whole script was read
+ **/
+static bool read_script (Script_t* s, FILE* file) {
+	const Access_Names_t names = { root_matrix_name, file_matrix_name, set_name, s };
+	char* line = NULL;
+	size_t line_cap = 0;
+	ssize_t len;
+	while ((len = getline(&line, &line_cap, file)) >= 0) {
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+			line[--len] = '\0';
+		}
+		if (strspn(line, " \t") == (size_t) len) {
+			continue;
+		}
+		if (strncmp(line, "exit", strlen("exit") + 1) == 0) {
+			break;
+		}
+		if (!reserve((void**) &s->commands, &s->commands_cap, s->num_commands, sizeof(Script_Command_t))) {
+			free(line);
+			return false;
+		}
+		const unsigned int index = s->num_commands++;
+		Script_Command_t* c = &s->commands[index];
+		c->line = strdup(line);
+		if (!c->line || !parse_user_input(line, &c->cmd)) {
+			printf("Failed at parsing line %u of the script\n", index + 1);
+			free(line);
+			return false;
+		}
+		if (c->cmd->num_cmds < 2) {
+			destroy_commands(&c->cmd);
+			continue;
+		}
+
+		Command_Access_t access;
+		if (!analyse_command(&names, c->cmd, &access) || !add_command_edges(s, index, &access)) {
+			free(line);
+			return false;
+		}
+		s->matrix_writers += access.writes_matrix || access.barrier;
+	}
+	free(line);
+	return true;
+}
+
+/*
+ * PURPOSE: prints every finished command whose earlier lines are all
+ *	printed, echoing the line first. Called with the output lock held.
+ * INPUTS:
+ *	s the script
+ * RETURN:
+ *	void
+ **/
+static void print_finished_output (Script_t* s) {
+	while (s->next_output < s->num_commands && s->commands[s->next_output].done) {
+		Script_Command_t* c = &s->commands[s->next_output++];
+		fprintf(s->out, "> %s\n", c->line);
+		if (c->output) {
+			fwrite(c->output, 1, c->output_len, s->out);
+			free(c->output);
+			c->output = NULL;
+		}
+	}
+}
+
+/*
+ * PURPOSE: queues a ready command on a worker
+ * INPUTS:
+ *	s the script
+ *	worker the worker whose queue gets it
+ *	index the command
+ * RETURN:
+ *	void
+ **/
+static void push_command (Script_t* s, unsigned int worker, unsigned int index) {
+	Script_Queue_t* q = &s->queues[worker];
+	/*counted first so a thief never takes a command that is not counted yet*/
+	pthread_mutex_lock(&s->idle_lock);
+	++s->queued;
+	pthread_mutex_unlock(&s->idle_lock);
+
+	pthread_mutex_lock(&q->lock);
+	q->tasks[q->tail++] = index;
+	pthread_mutex_unlock(&q->lock);
+
+	pthread_mutex_lock(&s->idle_lock);
+	pthread_cond_signal(&s->idle);
+	pthread_mutex_unlock(&s->idle_lock);
+}
+
+/*
+ * PURPOSE: takes a command from a queue, newest first from the worker's
+ *	own queue and oldest first from another's
+ * INPUTS:
+ *	q the queue
+ *	own true if the queue belongs to the caller
+ *	index where the command goes
+ * RETURN:
+ *	true if a command was taken
+ **/
+static bool pop_command (Script_Queue_t* q, bool own, unsigned int* index) {
+	pthread_mutex_lock(&q->lock);
+	const bool found = q->head < q->tail;
+	if (found) {
+		*index = own ? q->tasks[--q->tail] : q->tasks[q->head++];
+	}
+	if (q->head == q->tail) {
+		q->head = q->tail = 0;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return found;
+}
+
+/*
+ * PURPOSE: waits for the next command a worker should run, stealing from
+ *	other workers when its own queue is empty
+ * INPUTS:
+ *	s the script
+ *	self the worker
+ *	index where the command goes
+ * RETURN:
+ *	true if a command was taken, false once the script is finished
+ **/
+static bool take_command (Script_t* s, unsigned int self, unsigned int* index) {
+	for (;;) {
+		for (unsigned int k = 0; k < s->jobs; ++k) {
+			const unsigned int victim = (self + k) % s->jobs;
+			if (pop_command(&s->queues[victim], victim == self, index)) {
+				pthread_mutex_lock(&s->idle_lock);
+				--s->queued;
+				pthread_mutex_unlock(&s->idle_lock);
+				return true;
+			}
+		}
+		pthread_mutex_lock(&s->idle_lock);
+		while (s->queued == 0 && s->remaining > 0) {
+			pthread_cond_wait(&s->idle, &s->idle_lock);
+		}
+		const bool finished = s->remaining == 0;
+		pthread_mutex_unlock(&s->idle_lock);
+		if (finished) {
+			return false;
+		}
+	}
+}
+
+/*
+ * PURPOSE: runs one command with its output captured, then readies the
+ *	commands waiting on it and prints whatever output is now in order
+ * INPUTS:
+ *	s the script
+ *	self the worker running it
+ *	index the command
+ * RETURN:
+ *	void
+ **/
+static void run_script_command (Script_t* s, unsigned int self, unsigned int index) {
+	Script_Command_t* c = &s->commands[index];
+	/*without a capture the output still appears, just not in order*/
+	FILE* capture = capture_command_output(&c->output, &c->output_len);
+	Matrix_Pin_t pin;
+	hold_matrix_pins(&pin);
+	run_commands(c->cmd, s->registry, s->registry_len);
+	release_matrix_pins(&pin);
+	end_command_output(capture);
+
+	for (unsigned int i = 0; i < c->num_dependents; ++i) {
+		const unsigned int next = c->dependents[i];
+		if (__atomic_sub_fetch(&s->commands[next].waiting, 1, __ATOMIC_ACQ_REL) == 0) {
+			push_command(s, self, next);
+		}
+	}
+
+	pthread_mutex_lock(&s->output_lock);
+	c->done = true;
+	print_finished_output(s);
+	pthread_mutex_unlock(&s->output_lock);
+
+	pthread_mutex_lock(&s->idle_lock);
+	if (--s->remaining == 0) {
+		pthread_cond_broadcast(&s->idle);
+	}
+	pthread_mutex_unlock(&s->idle_lock);
+}
+
+/*
+ * PURPOSE: runs commands until the script is finished
+ * INPUTS:
+ *	arg the Script_Worker_t of this worker
+ * RETURN:
+ *	NULL
+ **/
+static void* script_worker (void* arg) {
+	Script_Worker_t* w = arg;
+	unsigned int index = 0;
+	while (take_command(w->script, w->id, &index)) {
+		run_script_command(w->script, w->id, index);
+	}
+	return NULL;
+}
+
+/*
+ * PURPOSE: runs the command graph on the worker pool, the calling thread
+ *	being worker 0
+ * INPUTS:
+ *	s the script with its registry and output set up
+ * RETURN:
+ *	true if every worker could be given a queue
+ **/
+static bool run_workers (Script_t* s) {
+	for (unsigned int i = 0; i < s->jobs; ++i) {
+		pthread_mutex_init(&s->queues[i].lock, NULL);
+		s->queues[i].tasks = malloc((s->num_commands + 1) * sizeof(unsigned int));
+		if (!s->queues[i].tasks) {
+			printf("Out of memory starting the script\n");
+			s->jobs = i;
+			return false;
+		}
+	}
+	pthread_mutex_init(&s->idle_lock, NULL);
+	pthread_cond_init(&s->idle, NULL);
+	pthread_mutex_init(&s->output_lock, NULL);
+
+	unsigned int next_worker = 0;
+	for (unsigned int i = 0; i < s->num_commands; ++i) {
+		Script_Command_t* c = &s->commands[i];
+		if (!c->cmd) {
+			c->done = true;
+		}
+		else {
+			++s->remaining;
+			if (c->waiting == 0) {
+				Script_Queue_t* q = &s->queues[next_worker++ % s->jobs];
+				q->tasks[q->tail++] = i;
+				++s->queued;
+			}
+		}
+	}
+	print_finished_output(s);
+
+	pthread_t ids[MAX_SCRIPT_JOBS];
+	Script_Worker_t workers[MAX_SCRIPT_JOBS];
+	bool started[MAX_SCRIPT_JOBS] = { false };
+	for (unsigned int i = 0; i < s->jobs; ++i) {
+		workers[i].script = s;
+		workers[i].id = i;
+	}
+	for (unsigned int i = 1; i < s->jobs; ++i) {
+		/*a worker that fails to start just leaves its queue to be stolen from*/
+		started[i] = pthread_create(&ids[i], NULL, script_worker, &workers[i]) == 0;
+	}
+	script_worker(&workers[0]);
+	for (unsigned int i = 1; i < s->jobs; ++i) {
+		if (started[i]) {
+			pthread_join(ids[i], NULL);
+		}
+	}
+	print_finished_output(s);
+	return true;
+}
+
+/*
+ * PURPOSE: orders matrices from least to most recently used
+ * INPUTS:
+ *	a b pointers to the matrices
+ * RETURN:
+ *	negative, zero or positive as for qsort
+ **/
+static int compare_last_used (const void* a, const void* b) {
+	const Matrix_t* x = *(Matrix_t* const*) a;
+	const Matrix_t* y = *(Matrix_t* const*) b;
+	return (x->last_used > y->last_used) - (x->last_used < y->last_used);
+}
+
+/*
+ * PURPOSE: frees everything read from the script
+ * INPUTS:
+ *	s the script
+ * RETURN:
+ *	void
+ **/
+static void destroy_script (Script_t* s) {
+	for (unsigned int i = 0; i < s->num_commands; ++i) {
+		if (s->commands[i].cmd) {
+			destroy_commands(&s->commands[i].cmd);
+		}
+		free(s->commands[i].line);
+		free(s->commands[i].dependents);
+		free(s->commands[i].output);
+	}
+	for (unsigned int i = 0; i < s->num_resources; ++i) {
+		free(s->resources[i].readers);
+	}
+	for (unsigned int i = 0; i < s->jobs; ++i) {
+		free(s->queues[i].tasks);
+	}
+	free(s->commands);
+	free(s->resources);
+	free(s->names);
+	free(s->registry);
+	free(s);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Runs a script of commands, one per line, running commands that
+*		   touch different matrices and files at the same time. Each line
+*		   is echoed and followed by its output in script order, so the
+*		   output matches running the lines one after another
+* Input: The script file,
+*		 the array of matrices,
+*		 the number of matrices,
+*		 the number of worker threads, 0 for one per cpu
+* Return: True if the script was read and run
+***/
+bool run_script (const char* script_filename, Matrix_t** mats, unsigned int num_mats, unsigned int jobs) {
+	TRACE_SCOPE("run_script", "command");
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!script_filename || !mats || num_mats == 0) {
+		printf("No script given\n");
+		return false;
+	}
+
+	FILE* file = fopen(script_filename, "r");
+	if (!file) {
+		perror(script_filename);
+		return false;
+	}
+	Script_t* s = calloc(1, sizeof(Script_t));
+	if (!s) {
+		fclose(file);
+		return false;
+	}
+	s->last_barrier = -1;
+	const bool loaded = read_script(s, file);
+	fclose(file);
+	if (!loaded) {
+		destroy_script(s);
+		return false;
+	}
+
+	if (jobs == 0) {
+		const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus > 0 ? (unsigned int) cpus : 1;
+	}
+	/*one per cpu stops at the most workers there is room for*/
+	s->jobs = jobs > MAX_SCRIPT_JOBS ? MAX_SCRIPT_JOBS : jobs;
+
+	/*room for every matrix the script can make, so nothing is evicted while it runs*/
+	s->registry_len = num_mats + s->matrix_writers;
+	s->registry = calloc(s->registry_len, sizeof(Matrix_t*));
+	s->out = s->registry ? redirect_command_output() : NULL;
+	if (!s->out) {
+		printf("Failed to start the script\n");
+		destroy_script(s);
+		return false;
+	}
+
+	unsigned int moved = 0;
+	for (unsigned int i = 0; i < num_mats; ++i) {
+		if (mats[i]) {
+			s->registry[moved++] = mats[i];
+			mats[i] = NULL;
+		}
+	}
+	const bool ran = run_workers(s);
+	restore_command_output(s->out);
+
+	/*hand the matrices back, the most recently used keep their slots*/
+	moved = 0;
+	for (unsigned int i = 0; i < s->registry_len; ++i) {
+		if (s->registry[i]) {
+			s->registry[moved++] = s->registry[i];
+		}
+	}
+	qsort(s->registry, moved, sizeof(Matrix_t*), compare_last_used);
+	begin_matrix_command();
+	for (unsigned int i = 0; i < moved; ++i) {
+		if (add_matrix_to_array(mats, s->registry[i], num_mats) == (unsigned int) -1) {
+			destroy_matrix(&s->registry[i]);
+		}
+	}
+	destroy_script(s);
+	return ran;
+}
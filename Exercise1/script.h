@@ -0,0 +1,8 @@
+#ifndef _SCRIPT_H_
+#define _SCRIPT_H_
+
+#define MAX_SCRIPT_JOBS 64
+
+bool run_script (const char* script_filename, Matrix_t** mats, unsigned int num_mats, unsigned int jobs);
+
+#endif
@@ -0,0 +1,1338 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "command.h"
+#include "matrix.h"
+#include "access.h"
+#include "server.h"
+
+#define MAX_EVENTS 64
+#define READ_CHUNK 65536
+#define MAX_LINE_LEN 4096
+#define PULL_CHUNK_VALUES 16384
+#define MAX_PUSH_BYTES (1ULL << 30)	/* larger pushes are refused before anything is allocated */
+#define MAX_HELD_LOCKS (MAX_ACCESSES + 2)
+
+/*defined in main.c*/
+void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats);
+unsigned int find_matrix_given_name (Matrix_t** mats, unsigned int num_mats,
+			const char* target);
+
+/*
+ * One client. Text commands are buffered in `in` until a newline arrives,
+ * replies wait in `out` until the socket accepts them. While a push frame
+ * is pending its payload is read straight into push_matrix. Commands, the
+ * end of a push and every chunk of a pull run as jobs on the worker pool,
+ * one job per client at a time so replies keep their order; nothing more
+ * is read from the client while its job runs or a pull frame is pending.
+ * The pull fields belong to the job while busy is set.
+ */
+typedef struct Connection {
+	int fd;
+	char* in;
+	size_t in_len;
+	size_t in_cap;
+	char* out;
+	size_t out_len;
+	size_t out_off;
+	unsigned int events;	/* what the event loop currently waits for */
+	bool closing;
+	bool busy;	/* a job for this client is queued or running */
+	bool dead;	/* closed while busy, freed once the job is back */
+	Matrix_t* push_matrix;
+	size_t push_filled;
+	size_t push_bytes;
+	bool pulling;	/* a pull frame is being sent */
+	Matrix_t* pull_matrix;	/* a view, or a generated copy, being sent */
+	unsigned int pull_version;	/* owner version the frame started from */
+	unsigned long long pull_next;	/* index of the next value to send */
+	struct Connection* prev;
+	struct Connection* next;
+} Connection_t;
+
+typedef enum {
+	JOB_COMMAND,	/* a text command, its printed output is the reply */
+	JOB_PUSH,	/* adds a fully received push to the list */
+	JOB_PULL,	/* makes the header or the next chunk of a pull frame */
+	JOB_RELEASE	/* lets go of the view of a pull frame that was cut off */
+} Server_Job_Kind_t;
+
+typedef struct Server_Job {
+	Server_Job_Kind_t kind;
+	Connection_t* c;	/* NULL for JOB_RELEASE */
+	char* line;	/* the command, or the matrix to pull */
+	Matrix_t* matrix;	/* the pushed matrix or the view to release */
+	char* output;	/* what goes back to the client */
+	size_t output_len;
+	bool pull_done;	/* the pull frame is complete */
+	bool failed;	/* the client must be disconnected */
+	struct Server_Job* next;
+} Server_Job_t;
+
+/*
+ * Jobs wait in a queue for the workers and come back on the done list,
+ * with done_fd telling the event loop to pick them up.
+ */
+typedef struct {
+	Matrix_t** mats;
+	unsigned int num_mats;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	Server_Job_t* head;
+	Server_Job_t* tail;
+	Server_Job_t* done;
+	int done_fd;
+	bool stopping;
+} Server_Pool_t;
+
+/*
+ * A reader-writer lock for each matrix ("m:<owner>") and file ("f:<file>")
+ * in use, made on first use and freed when no job holds or waits for it.
+ * Every job also holds the barrier lock, commands that touch everything
+ * for writing and the rest for reading. Locks are taken in name order so
+ * jobs never wait on each other in a circle.
+ */
+typedef struct Resource_Lock {
+	char name[RESOURCE_LEN];
+	pthread_rwlock_t lock;
+	unsigned int users;
+	struct Resource_Lock* next;
+} Resource_Lock_t;
+
+typedef struct {
+	bool barrier;
+	unsigned int count;
+	Resource_Lock_t* locks[MAX_HELD_LOCKS];
+	bool write[MAX_HELD_LOCKS];
+} Held_Locks_t;
+
+static volatile sig_atomic_t stop_serving = 0;
+static Connection_t* connections = NULL;
+static Server_Pool_t pool = { NULL, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+		NULL, NULL, NULL, -1, false };
+static pthread_mutex_t resource_table_lock = PTHREAD_MUTEX_INITIALIZER;
+static Resource_Lock_t* resource_locks = NULL;
+static pthread_rwlock_t barrier_lock;
+static pthread_rwlockattr_t lock_attributes;
+static char done_marker;	/* epoll data of done_fd */
+
+/*
+ * PURPOSE: signal handler that asks the event loop to finish
+ * INPUTS:
+ *	sig the received signal
+ * RETURN:
+ *	void
+ **/
+static void request_stop (int sig) {
+	(void) sig;
+	stop_serving = 1;
+}
+
+/*
+ * PURPOSE: the matrix owning the data of a matrix in the list right now
+ * INPUTS:
+ *	context the pool
+ *	name the matrix name
+ *	root where the owner name goes, MATRIX_NAME_LEN bytes
+ * RETURN:
+ *	void
+ **/
+static void owner_matrix_name (void* context, const char* name, char* root) {
+	const Server_Pool_t* p = context;
+	if (!find_matrix_owner(p->mats, p->num_mats, name, root)) {
+		snprintf(root, MATRIX_NAME_LEN, "%s", name);
+	}
+}
+
+/*
+ * PURPOSE: the name read gives a matrix file as it is now
+ * INPUTS:
+ *	context unused
+ *	file the matrix file
+ *	name where the name goes, MATRIX_NAME_LEN bytes
+ * RETURN:
+ *	true if the file holds a matrix
+ **/
+static bool current_file_matrix_name (void* context, const char* file, char* name) {
+	(void) context;
+	return read_matrix_name(file, name);
+}
+
+/*
+ * PURPOSE: names are looked up in the list each time, nothing is recorded
+ * INPUTS:
+ *	context key value unused
+ * RETURN:
+ *	true
+ **/
+static bool ignore_name (void* context, const char* key, const char* value) {
+	(void) context;
+	(void) key;
+	(void) value;
+	return true;
+}
+
+static const Access_Names_t server_names = { owner_matrix_name, current_file_matrix_name, ignore_name, &pool };
+
+/*
+ * PURPOSE: finds the lock of a resource, making it if it is new, and
+ *	counts the caller as a user
+ * INPUTS:
+ *	name the resource
+ * RETURN:
+ *	the lock, NULL if out of memory
+ **/
+static Resource_Lock_t* use_resource_lock (const char* name) {
+	pthread_mutex_lock(&resource_table_lock);
+	Resource_Lock_t* r = resource_locks;
+	while (r && strcmp(r->name, name) != 0) {
+		r = r->next;
+	}
+	if (!r) {
+		r = calloc(1, sizeof(Resource_Lock_t));
+		if (r) {
+			snprintf(r->name, sizeof(r->name), "%s", name);
+			pthread_rwlock_init(&r->lock, &lock_attributes);
+			r->next = resource_locks;
+			resource_locks = r;
+		}
+	}
+	if (r) {
+		++r->users;
+	}
+	pthread_mutex_unlock(&resource_table_lock);
+	return r;
+}
+
+/*
+ * PURPOSE: stops using the lock of a resource, freeing it once unused
+ * INPUTS:
+ *	r the lock
+ * RETURN:
+ *	void
+ **/
+static void drop_resource_lock (Resource_Lock_t* r) {
+	pthread_mutex_lock(&resource_table_lock);
+	if (--r->users == 0) {
+		Resource_Lock_t** link = &resource_locks;
+		while (*link != r) {
+			link = &(*link)->next;
+		}
+		*link = r->next;
+		pthread_rwlock_destroy(&r->lock);
+		free(r);
+	}
+	pthread_mutex_unlock(&resource_table_lock);
+}
+
+/*
+ * PURPOSE: lists the resources of a command once each in name order,
+ *	a resource both read and written counting as written
+ * INPUTS:
+ *	a what the command reads and writes
+ *	names receives the resources
+ *	write receives whether each one is written
+ * RETURN:
+ *	how many resources there are
+ **/
+static unsigned int sorted_resources (const Command_Access_t* a, const char* names[], bool write[]) {
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < a->num_writes + a->num_reads; ++i) {
+		const bool writes = i < a->num_writes;
+		const char* name = writes ? a->writes[i] : a->reads[i - a->num_writes];
+		unsigned int at = 0;
+		while (at < count && strcmp(names[at], name) < 0) {
+			++at;
+		}
+		if (at < count && strcmp(names[at], name) == 0) {
+			write[at] |= writes;
+			continue;
+		}
+		memmove(names + at + 1, names + at, (count - at) * sizeof(const char*));
+		memmove(write + at + 1, write + at, (count - at) * sizeof(bool));
+		names[at] = name;
+		write[at] = writes;
+		++count;
+	}
+	return count;
+}
+
+/*
+ * PURPOSE: releases every lock lock_accesses took
+ * INPUTS:
+ *	held the locks
+ * RETURN:
+ *	void
+ **/
+static void unlock_accesses (Held_Locks_t* held) {
+	while (held->count > 0) {
+		Resource_Lock_t* r = held->locks[--held->count];
+		pthread_rwlock_unlock(&r->lock);
+		drop_resource_lock(r);
+	}
+	pthread_rwlock_unlock(&barrier_lock);
+}
+
+/*
+ * PURPOSE: waits until a command may run: the barrier lock, then the
+ *	lock of every resource it reads or writes in name order
+ * INPUTS:
+ *	a what the command reads and writes
+ *	held receives the locks
+ * RETURN:
+ *	true, false if out of memory with nothing held
+ **/
+static bool lock_accesses (const Command_Access_t* a, Held_Locks_t* held) {
+	const char* names[MAX_HELD_LOCKS];
+	bool write[MAX_HELD_LOCKS];
+	const unsigned int count = a->barrier ? 0 : sorted_resources(a, names, write);
+	held->barrier = a->barrier;
+	held->count = 0;
+	if (a->barrier) {
+		pthread_rwlock_wrlock(&barrier_lock);
+	}
+	else {
+		pthread_rwlock_rdlock(&barrier_lock);
+	}
+	for (unsigned int i = 0; i < count; ++i) {
+		Resource_Lock_t* r = use_resource_lock(names[i]);
+		if (!r) {
+			printf("Out of memory locking %s\n", names[i]);
+			unlock_accesses(held);
+			return false;
+		}
+		if (write[i]) {
+			pthread_rwlock_wrlock(&r->lock);
+		}
+		else {
+			pthread_rwlock_rdlock(&r->lock);
+		}
+		held->locks[held->count] = r;
+		held->write[held->count++] = write[i];
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: tells whether held locks still cover what a command reads and
+ *	writes, which changes when a view or file was redefined meanwhile
+ * INPUTS:
+ *	held the locks
+ *	a what the command reads and writes now
+ * RETURN:
+ *	true if the locks are exactly the ones a needs
+ **/
+static bool holds_accesses (const Held_Locks_t* held, const Command_Access_t* a) {
+	const char* names[MAX_HELD_LOCKS];
+	bool write[MAX_HELD_LOCKS];
+	if (held->barrier || a->barrier) {
+		return held->barrier == a->barrier;
+	}
+	const unsigned int count = sorted_resources(a, names, write);
+	if (count != held->count) {
+		return false;
+	}
+	for (unsigned int i = 0; i < count; ++i) {
+		if (strcmp(names[i], held->locks[i]->name) != 0 || write[i] != held->write[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: locks one matrix, by the matrix that owns its data
+ * INPUTS:
+ *	name the matrix
+ *	write true to change it
+ *	held receives the locks
+ * RETURN:
+ *	true if locked
+ **/
+static bool lock_matrix_name (const char* name, bool write, Held_Locks_t* held) {
+	for (;;) {
+		Command_Access_t access;
+		memset(&access, 0, sizeof(access));
+		add_command_access(&server_names, &access, 'm', name, write);
+		if (!lock_accesses(&access, held)) {
+			return false;
+		}
+		Command_Access_t now;
+		memset(&now, 0, sizeof(now));
+		add_command_access(&server_names, &now, 'm', name, write);
+		if (holds_accesses(held, &now)) {
+			return true;
+		}
+		unlock_accesses(held);
+	}
+}
+
+/*
+ * PURPOSE: locks the owner of a pull frame's view by its name, which a
+ *	detached owner keeps, and not by what that name means now
+ * INPUTS:
+ *	owner the matrix owning the view's data
+ *	held receives the locks
+ * RETURN:
+ *	true if locked
+ **/
+static bool lock_view_owner (const Matrix_t* owner, Held_Locks_t* held) {
+	Command_Access_t access;
+	memset(&access, 0, sizeof(access));
+	snprintf(access.reads[access.num_reads++], RESOURCE_LEN, "m:%s", owner->name);
+	return lock_accesses(&access, held);
+}
+
+/*
+ * PURPOSE: runs a parsed command once it holds the locks of everything it
+ *	reads and writes. The accesses are worked out again once locked and
+ *	the locks taken again if another command changed them meanwhile
+ * INPUTS:
+ *	cmd the command
+ * RETURN:
+ *	void
+ **/
+static void run_locked_command (Commands_t* cmd) {
+	Command_Access_t access;
+	Held_Locks_t held;
+	if (!analyse_command(&server_names, cmd, &access)) {
+		return;
+	}
+	for (;;) {
+		if (!lock_accesses(&access, &held)) {
+			return;
+		}
+		Command_Access_t now;
+		if (!analyse_command(&server_names, cmd, &now)) {
+			unlock_accesses(&held);
+			return;
+		}
+		if (holds_accesses(&held, &now)) {
+			break;
+		}
+		unlock_accesses(&held);
+		access = now;
+	}
+	Matrix_Pin_t pin;
+	hold_matrix_pins(&pin);
+	run_commands(cmd, pool.mats, pool.num_mats);
+	release_matrix_pins(&pin);
+	unlock_accesses(&held);
+}
+
+/*
+ * PURPOSE: adds a fully received push to the list, replacing the matrix
+ *	of the same name
+ * INPUTS:
+ *	job the push job
+ * RETURN:
+ *	void
+ **/
+static void finish_push (Server_Job_t* job) {
+	Matrix_t* m = job->matrix;
+	job->matrix = NULL;
+	Held_Locks_t held;
+	if (!lock_matrix_name(m->name, true, &held)) {
+		destroy_matrix(&m);
+		printf("Push failed\n");
+		return;
+	}
+	Matrix_Pin_t pin;
+	hold_matrix_pins(&pin);
+	if (add_matrix_to_array(pool.mats, m, pool.num_mats) == (unsigned int) -1) {
+		destroy_matrix(&m);
+		printf("Push failed\n");
+	}
+	else {
+		printf("Matrix (%s) is pushed\n", m->name);
+	}
+	release_matrix_pins(&pin);
+	unlock_accesses(&held);
+}
+
+/*
+ * PURPOSE: lets go of the view or generated copy a pull frame sends. A
+ *	view is destroyed with the registry locked, as it may free a
+ *	detached owner, and with the owner locked by the caller
+ * INPUTS:
+ *	m the view or copy
+ * RETURN:
+ *	void
+ **/
+static void drop_pull_matrix (Matrix_t** m) {
+	lock_matrices();
+	destroy_matrix(m);
+	unlock_matrices();
+}
+
+/*
+ * PURPOSE: starts a pull frame: "PULL <rows> <cols>\n" and a view that
+ *	keeps the stored values alive and unspilled until the frame is sent,
+ *	or a copy of a generated matrix's rule so it is never stored.
+ *	"PULL 0 0\n" if the matrix does not exist
+ * INPUTS:
+ *	job the pull job
+ *	header receives the header
+ *	header_len receives its length
+ * RETURN:
+ *	true if values follow the header
+ **/
+static bool start_pull (Server_Job_t* job, char* header, int* header_len) {
+	Connection_t* c = job->c;
+	Held_Locks_t held;
+	if (!lock_matrix_name(job->line, false, &held)) {
+		job->failed = true;
+		return false;
+	}
+	Matrix_Pin_t pin;
+	hold_matrix_pins(&pin);
+	lock_matrices();
+	const unsigned int idx = find_matrix_given_name(pool.mats, pool.num_mats, job->line);
+	Matrix_t* m = idx == (unsigned int) -1 ? NULL : pool.mats[idx];
+	const unsigned int rows = m ? m->rows : 0;
+	const unsigned int cols = m ? m->cols : 0;
+	bool started = false;
+	if ((unsigned long long) rows * cols > 0) {
+		started = m->data
+				? create_view(&c->pull_matrix, m->name, m, 0, m->rows, 0, m->cols)
+				: generate_matrix(&c->pull_matrix, m->name, m->rows, m->cols, m->generator, m->gen_param);
+		if (!started) {
+			printf("Failed to start sending matrix %s\n", job->line);
+			job->failed = true;
+		}
+	}
+	unlock_matrices();
+	release_matrix_pins(&pin);
+
+	*header_len = snprintf(header, 64, "PULL %u %u\n", rows, cols);
+	if (started) {
+		c->pull_version = c->pull_matrix->parent ? c->pull_matrix->parent->version : 0;
+		c->pull_next = 0;
+	}
+	unlock_accesses(&held);
+	return started;
+}
+
+/*
+ * PURPOSE: makes the next chunk of a pull frame, with the header first.
+ *	Each chunk is copied with the owner locked for reading; if the values
+ *	changed since the frame started the frame cannot be completed and
+ *	the client is disconnected
+ * INPUTS:
+ *	job the pull job
+ * RETURN:
+ *	void
+ **/
+static void pull_values (Server_Job_t* job) {
+	Connection_t* c = job->c;
+	char header[64];
+	int header_len = 0;
+	if (!c->pull_matrix && !start_pull(job, header, &header_len)) {
+		job->pull_done = true;
+		job->output = job->failed ? NULL : strndup(header, header_len);
+		job->output_len = job->output ? header_len : 0;
+		job->failed |= !job->output;
+		return;
+	}
+
+	Matrix_t* m = c->pull_matrix;
+	const Matrix_t* owner = m->parent;
+	Held_Locks_t held;
+	if (owner && !lock_view_owner(owner, &held)) {
+		job->failed = true;
+		return;
+	}
+	const unsigned long long total = (unsigned long long) m->rows * m->cols;
+	const size_t count = total - c->pull_next < PULL_CHUNK_VALUES
+			? total - c->pull_next : PULL_CHUNK_VALUES;
+	job->output = owner && owner->version != c->pull_version
+			? NULL : malloc(header_len + count * sizeof(unsigned int));
+	if (!job->output) {
+		printf("Matrix %s changed or memory ran out while it was being pulled\n", m->name);
+		job->failed = true;
+	}
+	else {
+		memcpy(job->output, header, header_len);
+		unsigned int* values = (unsigned int*) (job->output + header_len);
+		job->output_len = header_len + count * sizeof(unsigned int);
+		if (m->data) {
+			for (size_t done = 0; done < count; ) {
+				const unsigned long long at = c->pull_next + done;
+				const unsigned int row = at / m->cols;
+				const unsigned int col = at % m->cols;
+				const size_t n = m->cols - col < count - done ? m->cols - col : count - done;
+				memcpy(values + done, m->data + (size_t) row * m->stride + col, n * sizeof(unsigned int));
+				done += n;
+			}
+		}
+		else {
+			generate_matrix_values(m, c->pull_next, count, values);
+		}
+		c->pull_next += count;
+	}
+	if (job->failed || c->pull_next == total) {
+		drop_pull_matrix(&c->pull_matrix);
+		job->pull_done = true;
+	}
+	if (owner) {
+		unlock_accesses(&held);
+	}
+}
+
+/*
+ * PURPOSE: lets go of the view of a pull frame whose client went away
+ * INPUTS:
+ *	job the release job
+ * RETURN:
+ *	void
+ **/
+static void release_view (Server_Job_t* job) {
+	Held_Locks_t held;
+	if (lock_view_owner(job->matrix->parent, &held)) {
+		drop_pull_matrix(&job->matrix);
+		unlock_accesses(&held);
+	}
+}
+
+/*
+ * PURPOSE: runs one job. What commands and pushes print is captured as
+ *	the reply; what pull jobs print goes to the server's stdout
+ * INPUTS:
+ *	job the job
+ * RETURN:
+ *	void
+ **/
+static void run_job (Server_Job_t* job) {
+	if (job->kind == JOB_PULL) {
+		pull_values(job);
+		return;
+	}
+	if (job->kind == JOB_RELEASE) {
+		release_view(job);
+		return;
+	}
+
+	FILE* capture = capture_command_output(&job->output, &job->output_len);
+	if (!capture) {
+		job->failed = true;
+	}
+	else if (job->kind == JOB_PUSH) {
+		finish_push(job);
+	}
+	else {
+		Commands_t* cmd = NULL;
+		if (parse_user_input(job->line, &cmd)) {
+			if (cmd->num_cmds > 1) {
+				run_locked_command(cmd);
+			}
+			else if (cmd->num_cmds == 1) {
+				printf("Not a command in this application\n");
+			}
+		}
+		if (cmd) {
+			destroy_commands(&cmd);
+		}
+	}
+	end_command_output(capture);
+}
+
+/*
+ * PURPOSE: takes jobs from the queue until the server stops, handing
+ *	each back to the event loop when done
+ * INPUTS:
+ *	arg unused
+ * RETURN:
+ *	NULL
+ **/
+static void* server_worker (void* arg) {
+	(void) arg;
+	for (;;) {
+		pthread_mutex_lock(&pool.lock);
+		while (!pool.head && !pool.stopping) {
+			pthread_cond_wait(&pool.ready, &pool.lock);
+		}
+		Server_Job_t* job = pool.head;
+		if (job) {
+			pool.head = job->next;
+			pool.tail = pool.head ? pool.tail : NULL;
+		}
+		pthread_mutex_unlock(&pool.lock);
+		if (!job) {
+			return NULL;
+		}
+
+		run_job(job);
+
+		pthread_mutex_lock(&pool.lock);
+		job->next = pool.done;
+		pool.done = job;
+		pthread_mutex_unlock(&pool.lock);
+		const unsigned long long one = 1;
+		if (write(pool.done_fd, &one, sizeof(one)) < 0) {
+			perror("eventfd");
+		}
+	}
+}
+
+/*
+ * PURPOSE: queues a job for the workers; the client waits for it
+ * INPUTS:
+ *	kind what to do
+ *	c the client, NULL for JOB_RELEASE
+ *	line the command or matrix name to copy into the job, or NULL
+ *	matrix the pushed matrix or the view to release, or NULL
+ * RETURN:
+ *	true if queued
+ **/
+static bool submit_job (Server_Job_Kind_t kind, Connection_t* c, const char* line, Matrix_t* matrix) {
+	Server_Job_t* job = calloc(1, sizeof(Server_Job_t));
+	if (!job || (line && !(job->line = strdup(line)))) {
+		printf("Out of memory queueing a job\n");
+		free(job);
+		return false;
+	}
+	job->kind = kind;
+	job->c = c;
+	job->matrix = matrix;
+	if (c) {
+		c->busy = true;
+	}
+	pthread_mutex_lock(&pool.lock);
+	if (pool.tail) {
+		pool.tail->next = job;
+	}
+	else {
+		pool.head = job;
+	}
+	pool.tail = job;
+	pthread_cond_signal(&pool.ready);
+	pthread_mutex_unlock(&pool.lock);
+	return true;
+}
+
+/*
+ * PURPOSE: makes room for bytes to be sent to a client. A reply that
+ *	cannot be queued would leave the client waiting for it, so the
+ *	connection is closed instead
+ * INPUTS:
+ *	c the client connection
+ *	len how many bytes to send
+ * RETURN:
+ *	where the bytes go, NULL if there is no memory for them
+ **/
+static char* reserve_output (Connection_t* c, size_t len) {
+	if (c->out_off == c->out_len) {
+		c->out_off = 0;
+		c->out_len = 0;
+	}
+	char* grown = realloc(c->out, c->out_len + len);
+	if (!grown) {
+		printf("Failed to queue %zu bytes for client %d\n", len, c->fd);
+		c->closing = true;
+		return NULL;
+	}
+	c->out = grown;
+	c->out_len += len;
+	return c->out + c->out_len - len;
+}
+
+/*
+ * PURPOSE: queues bytes to be sent to a client
+ * INPUTS:
+ *	c the client connection
+ *	bytes the data to send
+ *	len how many bytes to send
+ * RETURN:
+ *	true if the bytes were queued
+ **/
+static bool queue_output (Connection_t* c, const void* bytes, size_t len) {
+	if (len == 0) {
+		return true;
+	}
+	char* room = reserve_output(c, len);
+	if (!room) {
+		return false;
+	}
+	memcpy(room, bytes, len);
+	return true;
+}
+
+/*
+ * PURPOSE: sends as much queued output as the socket accepts, asking for
+ *	the next chunk of a pending pull frame once it is all sent, and
+ *	switches EPOLLIN and EPOLLOUT interest accordingly
+ * INPUTS:
+ *	epfd the event loop
+ *	c the client connection
+ * RETURN:
+ *	false if the connection failed and must be closed
+ **/
+static bool flush_output (int epfd, Connection_t* c) {
+	while (c->out_off < c->out_len) {
+		ssize_t sent = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if (sent <= 0) {
+			return false;
+		}
+		c->out_off += sent;
+	}
+	const bool pending = c->out_off < c->out_len;
+	if (!pending && c->pulling && !c->busy && !c->closing
+		&& !submit_job(JOB_PULL, c, NULL, NULL)) {
+		return false;
+	}
+	const unsigned int events = (c->busy || c->pulling ? 0 : EPOLLIN) | (pending ? EPOLLOUT : 0);
+	if (events != c->events) {
+		struct epoll_event ev = { .events = events, .data.ptr = c };
+		if (epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev)) {
+			return false;
+		}
+		c->events = events;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: starts a push frame. The header line is
+ *	"push <name> <rows> <cols>" and rows * cols raw unsigned ints follow.
+ *	The payload is received into a private matrix that only replaces
+ *	the registered one once it is complete. A payload larger than the
+ *	memory budget or MAX_PUSH_BYTES is refused and the client closed,
+ *	as the bytes that follow cannot be told apart from commands.
+ * INPUTS:
+ *	c the client connection
+ *	name the matrix to push into
+ *	rows the number of rows being pushed
+ *	cols the number of cols being pushed
+ * RETURN:
+ *	void
+ **/
+static void begin_push (Connection_t* c, const char* name, unsigned int rows, unsigned int cols) {
+	/*the payload is allocated before it arrives, so its size is checked first*/
+	const unsigned long long bytes = (unsigned long long) rows * cols * sizeof(unsigned int);
+	const unsigned long long budget = get_memory_budget();
+	const unsigned long long limit = budget && budget < MAX_PUSH_BYTES ? budget : MAX_PUSH_BYTES;
+	if (bytes > limit) {
+		char msg[128];
+		const int len = snprintf(msg, sizeof(msg), "Push failed, %u x %u is more than the %llu bytes a push may hold\n",
+				rows, cols, limit);
+		queue_output(c, msg, len);
+		c->closing = true;
+		return;
+	}
+	Matrix_t* m = NULL;
+	if (!create_matrix(&m, name, rows, cols)) {
+		const char msg[] = "Push failed\n";
+		queue_output(c, msg, sizeof(msg) - 1);
+		c->closing = true;
+		return;
+	}
+	c->push_matrix = m;
+	c->push_filled = 0;
+	c->push_bytes = (size_t) rows * cols * sizeof(unsigned int);
+}
+
+/*
+ * PURPOSE: hands a fully received push to the workers
+ * INPUTS:
+ *	c the client connection
+ * RETURN:
+ *	void
+ **/
+static void submit_push (Connection_t* c) {
+	if (!submit_job(JOB_PUSH, c, NULL, c->push_matrix)) {
+		destroy_matrix(&c->push_matrix);
+		c->closing = true;
+	}
+	c->push_matrix = NULL;
+	c->push_filled = 0;
+	c->push_bytes = 0;
+}
+
+/*
+ * PURPOSE: consumes complete lines in the input buffer, moving any bytes
+ *	after a push header into the push payload, until one of them needs
+ *	a job
+ * INPUTS:
+ *	c the client connection
+ * RETURN:
+ *	void
+ **/
+static void process_input (Connection_t* c) {
+	size_t start = 0;
+	while (!c->closing && !c->busy && !c->pulling && start < c->in_len) {
+		if (c->push_matrix) {
+			size_t take = c->in_len - start;
+			if (take > c->push_bytes - c->push_filled) {
+				take = c->push_bytes - c->push_filled;
+			}
+			memcpy((unsigned char*) c->push_matrix->data + c->push_filled, c->in + start, take);
+			c->push_filled += take;
+			start += take;
+			if (c->push_filled == c->push_bytes) {
+				submit_push(c);
+			}
+			continue;
+		}
+
+		char* newline = memchr(c->in + start, '\n', c->in_len - start);
+		if (!newline) {
+			if (c->in_len - start > MAX_LINE_LEN) {
+				c->closing = true;
+			}
+			break;
+		}
+		*newline = '\0';
+		char* line = c->in + start;
+		start = newline - c->in + 1;
+
+		/*one character more than a name can hold, so a long name fails instead of being cut*/
+		char name[MATRIX_NAME_LEN + 1];
+		unsigned int rows = 0;
+		unsigned int cols = 0;
+		if (sscanf(line, "push %25s %u %u", name, &rows, &cols) == 3) {
+			begin_push(c, name, rows, cols);
+			if (c->push_matrix && c->push_bytes == 0) {
+				submit_push(c);
+			}
+		}
+		else if (sscanf(line, "pull %25s", name) == 1) {
+			c->pulling = submit_job(JOB_PULL, c, name, NULL);
+			c->closing = !c->pulling;
+		}
+		else if (strncmp(line, "exit", strlen("exit") + 1) == 0) {
+			c->closing = true;
+		}
+		else if (line[0] != '\0') {
+			c->closing = !submit_job(JOB_COMMAND, c, line, NULL);
+		}
+	}
+	memmove(c->in, c->in + start, c->in_len - start);
+	c->in_len -= start;
+}
+
+/*
+ * PURPOSE: reads everything available from a client. Push payloads
+ *	are received directly into the destination matrix.
+ * INPUTS:
+ *	c the client connection
+ * RETURN:
+ *	false if the client hung up or the connection failed
+ **/
+static bool read_input (Connection_t* c) {
+	for (;;) {
+		ssize_t got;
+		if (c->push_matrix && c->in_len == 0) {
+			got = recv(c->fd, (unsigned char*) c->push_matrix->data + c->push_filled,
+					c->push_bytes - c->push_filled, 0);
+			if (got > 0) {
+				c->push_filled += got;
+				if (c->push_filled == c->push_bytes) {
+					submit_push(c);
+					return true;
+				}
+				continue;
+			}
+		}
+		else {
+			if (c->in_cap - c->in_len < READ_CHUNK) {
+				char* grown = realloc(c->in, c->in_cap + READ_CHUNK);
+				if (!grown) {
+					return false;
+				}
+				c->in = grown;
+				c->in_cap += READ_CHUNK;
+			}
+			got = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+			if (got > 0) {
+				c->in_len += got;
+				process_input(c);
+				if (c->closing || c->busy || c->pulling) {
+					return true;
+				}
+				continue;
+			}
+		}
+		if (got == 0) {
+			return false;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	}
+}
+
+/*
+ * PURPOSE: frees a client's buffers along with any half received push
+ *	or half sent pull. A view goes back through the workers, which lock
+ *	its owner, unless they have stopped
+ * INPUTS:
+ *	c the client connection, which no job uses
+ * RETURN:
+ *	void
+ **/
+static void free_connection (Connection_t* c) {
+	if (c->push_matrix) {
+		destroy_matrix(&c->push_matrix);
+	}
+	if (c->pull_matrix && (!c->pull_matrix->parent || pool.stopping
+		|| !submit_job(JOB_RELEASE, NULL, NULL, c->pull_matrix))) {
+		drop_pull_matrix(&c->pull_matrix);
+	}
+	free(c->in);
+	free(c->out);
+	free(c);
+}
+
+/*
+ * PURPOSE: closes a client. One with a job running is freed when the
+ *	job comes back
+ * INPUTS:
+ *	epfd the event loop
+ *	c the client connection
+ * RETURN:
+ *	void
+ **/
+static void close_connection (int epfd, Connection_t* c) {
+	if (c->prev) {
+		c->prev->next = c->next;
+	}
+	else {
+		connections = c->next;
+	}
+	if (c->next) {
+		c->next->prev = c->prev;
+	}
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	c->fd = -1;
+	if (c->busy) {
+		c->dead = true;
+	}
+	else {
+		free_connection(c);
+	}
+}
+
+/*
+ * PURPOSE: sends what a client has queued, reads on once it waits for
+ *	nothing, and closes it when it is finished or failed
+ * INPUTS:
+ *	epfd the event loop
+ *	c the client connection
+ *	alive false if the connection already failed
+ * RETURN:
+ *	void
+ **/
+static void serve_connection (int epfd, Connection_t* c, bool alive) {
+	if (alive) {
+		alive = flush_output(epfd, c);
+	}
+	if (!alive || (c->closing && !c->busy && c->out_off == c->out_len)) {
+		close_connection(epfd, c);
+	}
+}
+
+/*
+ * PURPOSE: takes back the jobs the workers finished, queues their
+ *	replies and lets their clients carry on with the commands that
+ *	arrived meanwhile
+ * INPUTS:
+ *	epfd the event loop
+ * RETURN:
+ *	void
+ **/
+static void finish_jobs (int epfd) {
+	unsigned long long count;
+	if (read(pool.done_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+		perror("eventfd");
+	}
+	pthread_mutex_lock(&pool.lock);
+	Server_Job_t* job = pool.done;
+	pool.done = NULL;
+	pthread_mutex_unlock(&pool.lock);
+
+	while (job) {
+		Server_Job_t* next = job->next;
+		Connection_t* c = job->c;
+		if (c) {
+			c->busy = false;
+			c->pulling &= !job->pull_done;
+			if (c->dead) {
+				free_connection(c);
+			}
+			else {
+				c->closing |= job->failed || !queue_output(c, job->output, job->output_len);
+				process_input(c);
+				serve_connection(epfd, c, true);
+			}
+		}
+		if (job->matrix) {
+			destroy_matrix(&job->matrix);
+		}
+		free(job->line);
+		free(job->output);
+		free(job);
+		job = next;
+	}
+}
+
+/*
+ * PURPOSE: accepts every pending client on the listening socket
+ * INPUTS:
+ *	epfd the event loop
+ *	listen_fd the listening socket
+ * RETURN:
+ *	void
+ **/
+static void accept_clients (int epfd, int listen_fd) {
+	for (;;) {
+		int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				perror("accept");
+			}
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		Connection_t* c = calloc(1, sizeof(Connection_t));
+		if (!c) {
+			close(fd);
+			continue;
+		}
+		c->fd = fd;
+		c->events = EPOLLIN;
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+			perror("epoll_ctl");
+			close(fd);
+			free(c);
+			continue;
+		}
+		c->next = connections;
+		if (connections) {
+			connections->prev = c;
+		}
+		connections = c;
+	}
+}
+
+/*
+ * PURPOSE: starts the worker pool and the locks its jobs take
+ * INPUTS:
+ *	epfd the event loop, which watches for finished jobs
+ *	mats the shared list of matrices
+ *	num_mats the number of matrices in the list
+ *	jobs the number of workers
+ *	ids receives the worker threads
+ * RETURN:
+ *	the number of workers started
+ **/
+static unsigned int start_workers (int epfd, Matrix_t** mats, unsigned int num_mats,
+			unsigned int jobs, pthread_t* ids) {
+	pthread_rwlockattr_init(&lock_attributes);
+	/*a barrier command or a writer is not starved by a stream of readers*/
+	pthread_rwlockattr_setkind_np(&lock_attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	pthread_rwlock_init(&barrier_lock, &lock_attributes);
+	pool.mats = mats;
+	pool.num_mats = num_mats;
+	pool.stopping = false;
+	pool.done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &done_marker };
+	if (pool.done_fd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, pool.done_fd, &ev)) {
+		perror("eventfd");
+		return 0;
+	}
+	unsigned int started = 0;
+	while (started < jobs && pthread_create(&ids[started], NULL, server_worker, NULL) == 0) {
+		++started;
+	}
+	return started;
+}
+
+/*
+ * PURPOSE: lets the workers finish the queued jobs, waits for them and
+ *	frees the clients that were closed while their job ran
+ * INPUTS:
+ *	ids the worker threads
+ *	started how many there are
+ * RETURN:
+ *	void
+ **/
+static void stop_workers (pthread_t* ids, unsigned int started) {
+	pthread_mutex_lock(&pool.lock);
+	pool.stopping = true;
+	pthread_cond_broadcast(&pool.ready);
+	pthread_mutex_unlock(&pool.lock);
+	for (unsigned int i = 0; i < started; ++i) {
+		pthread_join(ids[i], NULL);
+	}
+	if (pool.done_fd >= 0) {
+		finish_jobs(-1);
+		close(pool.done_fd);
+		pool.done_fd = -1;
+	}
+	pthread_rwlock_destroy(&barrier_lock);
+	pthread_rwlockattr_destroy(&lock_attributes);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Serves the list of matrices to many clients over a Unix domain
+*		   socket until SIGINT or SIGTERM. Each newline terminated line is
+*		   a run_commands command whose printed output is the reply, and
+*		   push/pull frames move raw matrix data without text encoding.
+*		   Commands run on a pool of workers, each holding a read or write
+*		   lock on every matrix and file it uses, so commands of different
+*		   clients on different matrices run at the same time
+* Input: The path of the socket to create,
+*		 the list of matrices,
+*		 the number of matrices in the list,
+*		 the number of worker threads, 0 for one per cpu
+* Return: True if the server ran and shut down cleanly
+***/
+bool serve_matrices (const char* socket_path, Matrix_t** mats, unsigned int num_mats, unsigned int jobs) {
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!socket_path) {
+		printf("No socket path given\n");
+		return false;
+	}
+	if (!mats) {
+		printf("No matrices found\n");
+		return false;
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) + 1 > sizeof(addr.sun_path)) {
+		printf("Socket path %s is too long\n", socket_path);
+		return false;
+	}
+	strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0) {
+		perror("socket");
+		return false;
+	}
+	unlink(socket_path);
+	if (bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(listen_fd, SOMAXCONN)) {
+		perror(socket_path);
+		close(listen_fd);
+		return false;
+	}
+
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		close(listen_fd);
+		unlink(socket_path);
+		return false;
+	}
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+	if (jobs == 0) {
+		const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus > 0 ? (unsigned int) cpus : 1;
+	}
+	/*one per cpu stops at the most workers there is room for*/
+	jobs = jobs > MAX_SERVER_JOBS ? MAX_SERVER_JOBS : jobs;
+	pthread_t ids[MAX_SERVER_JOBS];
+	FILE* real_stdout = redirect_command_output();
+	const unsigned int started = real_stdout ? start_workers(epfd, mats, num_mats, jobs, ids) : 0;
+	if (started == 0) {
+		printf("Failed to start the workers\n");
+		if (real_stdout) {
+			stop_workers(ids, 0);
+			restore_command_output(real_stdout);
+		}
+		close(epfd);
+		close(listen_fd);
+		unlink(socket_path);
+		return false;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = request_stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	printf("Serving matrices on %s\n", socket_path);
+	fflush(real_stdout);
+
+	struct epoll_event events[MAX_EVENTS];
+	while (!stop_serving) {
+		int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("epoll_wait");
+			break;
+		}
+		for (int i = 0; i < n; ++i) {
+			Connection_t* c = events[i].data.ptr;
+			if (!c) {
+				accept_clients(epfd, listen_fd);
+				continue;
+			}
+			if ((void*) c == &done_marker) {
+				finish_jobs(epfd);
+				continue;
+			}
+			/*jobs finished above may have closed this client*/
+			bool known = false;
+			for (const Connection_t* k = connections; k && !known; k = k->next) {
+				known = k == c;
+			}
+			if (!known) {
+				continue;
+			}
+			bool alive = true;
+			if ((events[i].events & (EPOLLHUP | EPOLLERR)) && c->busy) {
+				/*the reply of the running job has nowhere to go*/
+				alive = false;
+			}
+			else if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !c->busy && !c->pulling) {
+				alive = read_input(c);
+			}
+			serve_connection(epfd, c, alive);
+		}
+	}
+
+	while (connections) {
+		close_connection(epfd, connections);
+	}
+	stop_workers(ids, started);
+	restore_command_output(real_stdout);
+	close(epfd);
+	close(listen_fd);
+	unlink(socket_path);
+	return true;
+}
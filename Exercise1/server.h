@@ -0,0 +1,9 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#define MAX_SERVER_JOBS 64
+
+bool serve_matrices (const char* socket_path, Matrix_t** mats, unsigned int num_mats,
+			unsigned int jobs);
+
+#endif
@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+/* events kept per thread, older ones are overwritten once a ring is full */
+#define TRACE_RING_EVENTS (1 << 14)
+
+typedef struct {
+	const char* name;
+	const char* category;
+	unsigned long long ns;
+	int tid;
+	char phase;
+} Trace_Event_t;
+
+/*
+ * One ring per running thread. Only the thread that claimed a ring
+ * writes to it, so recording needs no locks. Rings are never freed while
+ * the program runs: a thread that exits gives its ring back and the next
+ * new thread claims it, so the number of rings follows the peak number
+ * of threads rather than every thread ever started.
+ */
+typedef struct Trace_Ring {
+	struct Trace_Ring* next;
+	int in_use;
+	unsigned long long session;
+	unsigned long long head;
+	Trace_Event_t events[TRACE_RING_EVENTS];
+} Trace_Ring_t;
+
+bool trace_enabled = false;
+
+static Trace_Ring_t* rings = NULL;
+static unsigned long long trace_session = 0;
+static FILE* trace_file = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static __thread Trace_Ring_t* thread_ring = NULL;
+static __thread int thread_id = 0;
+
+/*
+ * PURPOSE: hands the ring of an exiting thread back to the pool
+ * INPUTS:
+ *	ring the ring the thread claimed
+ * RETURN:
+ *	void
+ **/
+static void release_ring (void* ring) {
+	__atomic_store_n(&((Trace_Ring_t*) ring)->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * PURPOSE: creates the key whose destructor releases rings
+ * INPUTS:
+ *	none
+ * RETURN:
+ *	void
+ **/
+static void create_ring_key (void) {
+	pthread_key_create(&ring_key, release_ring);
+}
+
+/*
+ * PURPOSE: finds a free ring or adds a new one to the list, without locks
+ * INPUTS:
+ *	none
+ * RETURN:
+ *	the ring now owned by the calling thread, NULL if out of memory
+ **/
+static Trace_Ring_t* claim_ring (void) {
+	for (Trace_Ring_t* ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+		int expected = 0;
+		if (__atomic_compare_exchange_n(&ring->in_use, &expected, 1, false,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			return ring;
+		}
+	}
+	Trace_Ring_t* ring = calloc(1, sizeof(Trace_Ring_t));
+	if (!ring) {
+		return NULL;
+	}
+	ring->in_use = 1;
+	ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, true,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+	}
+	return ring;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Records one event in the ring of the calling thread
+* Input: The event name, which must outlive the trace,
+*		 the event category, which must outlive the trace,
+*		 'B' for begin or 'E' for end
+* Return: void
+***/
+void trace_event (const char* name, const char* category, char phase) {
+	if (!thread_ring) {
+		pthread_once(&ring_key_once, create_ring_key);
+		thread_ring = claim_ring();
+		if (!thread_ring) {
+			return;
+		}
+		pthread_setspecific(ring_key, thread_ring);
+		thread_id = (int) syscall(SYS_gettid);
+	}
+
+	Trace_Ring_t* ring = thread_ring;
+	const unsigned long long session = __atomic_load_n(&trace_session, __ATOMIC_RELAXED);
+	if (ring->session != session) {
+		ring->session = session;
+		ring->head = 0;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	Trace_Event_t* event = &ring->events[ring->head % TRACE_RING_EVENTS];
+	event->name = name;
+	event->category = category;
+	event->ns = (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+	event->tid = thread_id;
+	event->phase = phase;
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Starts recording events for a trace file
+* Input: The file the trace is written to by stop_trace
+* Return: True/False
+***/
+bool start_trace (const char* trace_filename) {
+
+	// ERROR CHECK INCOMING PARAMETERS
+	if (!trace_filename) {
+		printf("No trace file given\n");
+		return false;
+	}
+	if (trace_file) {
+		printf("Tracing is already on\n");
+		return false;
+	}
+
+	trace_file = fopen(trace_filename, "w");
+	if (!trace_file) {
+		perror(trace_filename);
+		return false;
+	}
+	__atomic_add_fetch(&trace_session, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&trace_enabled, true, __ATOMIC_RELEASE);
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Stops recording and writes the events of every thread to the
+*		   trace file as Chrome trace JSON. Must be called while no other
+*		   thread is recording, which holds between commands.
+* Input: No inputs
+* Return: True/False
+***/
+bool stop_trace (void) {
+	if (!trace_file) {
+		printf("Tracing is not on\n");
+		return false;
+	}
+	__atomic_store_n(&trace_enabled, false, __ATOMIC_RELEASE);
+
+	const int pid = (int) getpid();
+	const unsigned long long session = __atomic_load_n(&trace_session, __ATOMIC_RELAXED);
+	bool first = true;
+	fprintf(trace_file, "{\"traceEvents\":[");
+	for (Trace_Ring_t* ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+		const unsigned long long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if (ring->session != session) {
+			continue;
+		}
+		for (unsigned long long i = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0; i < head; ++i) {
+			const Trace_Event_t* event = &ring->events[i % TRACE_RING_EVENTS];
+			fprintf(trace_file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%d}",
+					first ? "" : ",", event->name, event->category, event->phase,
+					event->ns / 1000, event->ns % 1000, pid, event->tid);
+			first = false;
+		}
+	}
+	fprintf(trace_file, "\n]}\n");
+
+	const bool ok = !ferror(trace_file);
+	if (fclose(trace_file) || !ok) {
+		printf("Failed to write trace file\n");
+		trace_file = NULL;
+		return false;
+	}
+	trace_file = NULL;
+	return true;
+}
+
+	// FUNCTION COMMENT
+/***
+* Purpose: Writes out a running trace and frees every ring, for use
+*		   when the program exits
+* Input: No inputs
+* Return: void
+***/
+void destroy_trace (void) {
+	if (trace_file) {
+		stop_trace();
+	}
+	while (rings) {
+		Trace_Ring_t* next = rings->next;
+		free(rings);
+		rings = next;
+	}
+	thread_ring = NULL;
+}
@@ -0,0 +1,44 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/*
+ * Begin/end events for a Chrome trace (chrome://tracing, Perfetto).
+ * While tracing is off every probe costs one relaxed load and a branch.
+ */
+extern bool trace_enabled;
+
+typedef struct {
+	const char* name;
+	const char* category;
+} Trace_Scope_t;
+
+bool start_trace (const char* trace_filename);
+bool stop_trace (void);
+void destroy_trace (void);
+void trace_event (const char* name, const char* category, char phase);
+
+static inline Trace_Scope_t trace_scope_begin (const char* name, const char* category) {
+	Trace_Scope_t scope = { NULL, NULL };
+	if (__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED)) {
+		scope.name = name;
+		scope.category = category;
+		trace_event(name, category, 'B');
+	}
+	return scope;
+}
+
+static inline void trace_scope_end (Trace_Scope_t* scope) {
+	if (scope->name) {
+		trace_event(scope->name, scope->category, 'E');
+	}
+}
+
+/*
+ * Records a begin event now and the matching end event when the
+ * enclosing block is left, whichever return statement leaves it.
+ */
+#define TRACE_SCOPE(name, category) \
+	Trace_Scope_t trace_scope __attribute__((cleanup(trace_scope_end), unused)) = \
+		trace_scope_begin(name, category)
+
+#endif